@@ -0,0 +1,116 @@
+#!/bin/sh
+# Times every command of sheet on a synthetic table made by gentable
+# prints one tab separated line for each command, so that results of different commits can be compared:
+# command, rows, cols, bytes, runs, best ms, median ms, MB/s and rows/s of the best run
+#
+# settings are taken from the environment:
+# SHEET, GENTABLE - programs to use
+# ROWS, COLS, WIDTH, DELIMS - table given to gentable
+# RUNS - number of runs of every command
+# date +%s%N is needed for the time in nanoseconds
+
+SHEET=${SHEET:-./sheet}
+GENTABLE=${GENTABLE:-./bench/gentable}
+ROWS=${ROWS:-200000}
+COLS=${COLS:-10}
+WIDTH=${WIDTH:-1-12}
+DELIMS=${DELIMS:-" "}
+RUNS=${RUNS:-5}
+
+TABLE=${TMPDIR:-/tmp}/sheet_bench_$$.txt
+OUTPUT=${TMPDIR:-/tmp}/sheet_bench_$$.out
+trap 'rm -f "$TABLE" "$OUTPUT"' EXIT
+
+"$GENTABLE" -r "$ROWS" -c "$COLS" -w "$WIDTH" -d "$DELIMS" > "$TABLE" || exit 1
+BYTES=$(wc -c < "$TABLE")
+
+# runs sheet with the arguments RUNS times and prints the line of results
+# the first argument is the number of lines sheet has to print, so a command doing less work is not measured
+bench() {
+    lines=$1
+    shift
+    if ! "$SHEET" -d "$DELIMS" "$@" < "$TABLE" > "$OUTPUT" 2>&1; then
+        echo "failed: $*" >&2
+        return
+    fi
+    if [ "$(wc -l < "$OUTPUT")" -ne "$lines" ]; then
+        echo "wrong output: $* printed $(wc -l < "$OUTPUT") lines instead of $lines" >&2
+        return
+    fi
+
+    times=""
+    for i in $(seq "$RUNS"); do
+        start=$(date +%s%N)
+        if ! "$SHEET" -d "$DELIMS" "$@" < "$TABLE" > /dev/null 2>&1; then
+            echo "failed: $*" >&2
+            return
+        fi
+        end=$(date +%s%N)
+        times="$times $(( (end - start) / 1000 ))"
+    done
+
+    # times are in microseconds, bytes per microsecond are MB/s
+    echo $times | tr ' ' '\n' | sort -n | awk -v name="$*" -v rows="$ROWS" -v cols="$COLS" -v bytes="$BYTES" '
+        { t[NR] = ($1 > 0) ? $1 : 1 }
+        END {
+            best = t[1]; median = t[int((NR + 1) / 2)]
+            printf "%s\t%d\t%d\t%d\t%d\t%.3f\t%.3f\t%.1f\t%.0f\n", name, rows, cols, bytes, NR,
+                best / 1000, median / 1000, bytes / best, rows * 1000000 / best
+        }'
+}
+
+# checks, that both command lines print the same table, so the first one does all the work it should
+same() {
+    first=$("$SHEET" -d "$DELIMS" $1 < "$TABLE" 2>&1 | cksum)
+    second=$("$SHEET" -d "$DELIMS" $2 < "$TABLE" 2>&1 | cksum)
+    if [ "$first" != "$second" ]; then
+        echo "wrong output: $1 is not the same as $2" >&2
+    fi
+}
+
+# distinct cells in the first column, rows printed by groupby
+GROUPS=$(tr "$DELIMS" '\t' < "$TABLE" | cut -f 1 | sort -u | wc -l)
+
+printf "command\trows\tcols\tbytes\truns\tbest_ms\tmedian_ms\tmb_per_s\trows_per_s\n"
+
+# layout commands
+bench $((ROWS + 1)) irow 1
+bench $((ROWS + 1)) arow
+bench $((ROWS - 1)) drow 1
+bench $((ROWS - 1000)) drows 1 1000
+bench "$ROWS" icol 1
+bench "$ROWS" acol
+bench "$ROWS" dcol 1
+bench "$ROWS" dcols 1 3
+bench "$ROWS" project 3,1,-,2
+
+# data commands
+bench "$ROWS" cset 2 x
+bench "$ROWS" tolower 1
+bench "$ROWS" toupper 1
+bench "$ROWS" round 3
+bench "$ROWS" int 3
+bench "$ROWS" copy 1 2
+bench "$ROWS" swap 1 2
+bench "$ROWS" move 1 5
+bench "$ROWS" -j 4 round 3
+bench "$ROWS" --stream toupper 1
+bench "$ROWS" sort 3
+bench "$ROWS" sort 3 desc num
+bench "$ROWS" -j 4 sort 3
+bench "$ROWS" --sort-memory 1 sort 3
+bench 1 csum 3
+bench 1 cmax 3
+bench 1 -j 4 cavg 3
+bench "$ROWS" csum 3 1 1
+bench "$GROUPS" groupby 1 csum 3
+bench "$GROUPS" -j 4 groupby 1 cavg 3
+
+# selection commands
+same "rows 1 - toupper 1" "toupper 1"
+bench "$ROWS" rows 1 - toupper 1
+bench "$ROWS" contains 1 ab cset 2 x
+bench "$ROWS" beginswith 1 a cset 2 x
+bench "$ROWS" containsany 1 "ab|cd|xy" cset 2 x
+bench "$ROWS" containsall 1 "a|b" cset 2 x
+bench "$ROWS" matches 1 "^[a-m]+[0-9]" cset 2 x
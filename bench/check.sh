@@ -0,0 +1,44 @@
+#!/bin/sh
+# Checks results of commands, which the benchmarks cannot see
+# prints the failed checks and exits with 1, if there are any
+#
+# settings are taken from the environment:
+# SHEET - program to check
+
+SHEET=${SHEET:-./sheet}
+failures=0
+
+# runs sheet with the arguments on the input and compares its output with the expected one
+check() {
+    input=$1
+    expected=$2
+    shift 2
+    output=$(printf "$input" | "$SHEET" "$@" 2>&1)
+    if [ "$output" != "$(printf "$expected")" ]; then
+        echo "failed: $*" >&2
+        failures=$((failures + 1))
+    fi
+}
+
+# rows can be above the number of columns, - is the last row
+TABLE='a b\nc d\ne f\ng h\ni j\n'
+check "$TABLE" 'a b\nc d\nE f\nG h\ni j' rows 3 4 toupper 1
+check "$TABLE" 'A b\nC d\nE f\nG h\nI j' rows 1 - toupper 1
+check "$TABLE" 'a b\nc d\ne f\ng h\nI j' rows - - toupper 1
+check "$TABLE" 'a b\nc d\nE f\nG h\ni j' --stream rows 3 4 toupper 1
+check "$TABLE" 'a b\nc d\ne f\nG h\nI j' --stream rows 4 - toupper 1
+check "$TABLE" 'a b\nc d\ne f\ng h\nI j' --stream rows - - toupper 1
+check "$TABLE" 'Given cell coordinates are out of range' rows 5 6 toupper 1
+
+# a bad table keeps its error, even if its first row is empty
+check '\na:b\nc:d\n' 'Table has different numbers of columns in each row\nRow 2 has different number of columns than the first row' -d : toupper 1
+
+# {m,n} repeats, { is not taken as a character
+check 'x1 a\nx22 b\nx333 c\n' 'x1 a\nx22 B\nx333 C' matches 1 '^x[0-9]{2,}$' toupper 2
+check 'x{2} a\n' 'Bad regular expression' matches 1 'x{2' toupper 2
+
+if [ "$failures" -gt 0 ]; then
+    echo "$failures checks failed" >&2
+    exit 1
+fi
+echo "all checks passed"
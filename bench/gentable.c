@@ -0,0 +1,121 @@
+/**
+ * Generator of synthetic tables for the benchmarks of sheet
+ *
+ * Usage:
+ * ./gentable [-r ROWS] [-c COLS] [-w MIN-MAX] [-d DELIMS] [-n PERCENT] [-s SEED]
+ *
+ * -r number of rows (default 100000)
+ * -c number of columns (default 10)
+ * -w range of cell widths in characters (default 1-12)
+ * -d delimiters, every cell is followed by a random one of them (default " ")
+ * -n percentage of cells, which are decimal numbers (default 30)
+ * -s seed of the random generator (default 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    long rows;
+    int cols;
+    int minWidth;
+    int maxWidth;
+    const char *delimiters;
+    int numberPercent;
+    uint64_t seed;
+} generator_t;
+
+// xorshift, the same seed gives the same table everywhere
+uint64_t nextRandom(generator_t *gen) {
+    gen->seed ^= gen->seed << 13;
+    gen->seed ^= gen->seed >> 7;
+    gen->seed ^= gen->seed << 17;
+    return gen->seed;
+}
+
+// random number from min to max
+int randomRange(generator_t *gen, int min, int max) {
+    return min + nextRandom(gen) % (max - min + 1);
+}
+
+// writes one cell, either a decimal number or a word
+void writeCell(generator_t *gen, FILE *out) {
+    char cell[256];
+    int width = randomRange(gen, gen->minWidth, gen->maxWidth);
+
+    if (randomRange(gen, 1, 100) <= gen->numberPercent) {
+        // like -123.456
+        int i = 0;
+        if (nextRandom(gen) % 4 == 0)
+            cell[i++] = '-';
+        int intDigits = randomRange(gen, 1, 7);
+        for (int k=0; k<intDigits; k++)
+            cell[i++] = '0' + nextRandom(gen) % 10;
+        cell[i++] = '.';
+        for (int k=0; k<3; k++)
+            cell[i++] = '0' + nextRandom(gen) % 10;
+        fwrite(cell, 1, i, out);
+        return;
+    }
+
+    for (int i=0; i<width; i++) {
+        int c = nextRandom(gen) % 62;
+        cell[i] = (c < 26) ? 'a' + c : (c < 52) ? 'A' + c - 26 : '0' + c - 52;
+    }
+    fwrite(cell, 1, width, out);
+}
+
+// reads the options, returns false on bad syntax
+bool readOptions(int argc, char **argv, generator_t *gen) {
+    for (int i=1; i<argc; i++) {
+        if (i + 1 >= argc)
+            return false;
+        char *value = argv[++i];
+        char *option = argv[i-1];
+
+        if (strcmp(option, "-r") == 0)
+            gen->rows = atol(value);
+        else if (strcmp(option, "-c") == 0)
+            gen->cols = atoi(value);
+        else if (strcmp(option, "-w") == 0) {
+            if (sscanf(value, "%d-%d", &gen->minWidth, &gen->maxWidth) != 2)
+                return false;
+        }
+        else if (strcmp(option, "-d") == 0)
+            gen->delimiters = value;
+        else if (strcmp(option, "-n") == 0)
+            gen->numberPercent = atoi(value);
+        else if (strcmp(option, "-s") == 0)
+            gen->seed = strtoull(value, NULL, 10);
+        else
+            return false;
+    }
+
+    return (gen->rows >= 1) && (gen->cols >= 1) && (gen->minWidth >= 1)
+        && (gen->maxWidth >= gen->minWidth) && (gen->maxWidth < 256)
+        && (gen->delimiters[0] != '\0') && (gen->seed != 0);
+}
+
+int main(int argc, char **argv) {
+    generator_t gen = {.rows=100000, .cols=10, .minWidth=1, .maxWidth=12,
+        .delimiters=" ", .numberPercent=30, .seed=1};
+
+    if (!readOptions(argc, argv, &gen)) {
+        fputs("Usage: ./gentable [-r ROWS] [-c COLS] [-w MIN-MAX] [-d DELIMS] [-n PERCENT] [-s SEED]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    int numDelimiters = strlen(gen.delimiters);
+    for (long row=0; row<gen.rows; row++) {
+        for (int col=0; col<gen.cols; col++) {
+            writeCell(&gen, stdout);
+            if (col + 1 < gen.cols)
+                putchar(gen.delimiters[nextRandom(&gen) % numDelimiters]);
+        }
+        putchar('\n');
+    }
+    return EXIT_SUCCESS;
+}
@@ -6,35 +6,232 @@
 
 /*
 Implementation details
-The program has no extra commands
+Extra layout command:
+project C1,C2,... - the table gets columns C1, C2, ... in this order, - stands for a new empty column
+Extra selection commands:
+containsany C PATTERNS - cell in column C contains any of the patterns
+containsall C PATTERNS - cell in column C contains all of the patterns
+PATTERNS are given as a|b|c or as @FILE with one pattern on each line
+matches C REGEX - cell in column C matches the extended regular expression
+REGEX can use characters, ., [classes], (groups), |, *, +, ?, {m}, {m,}, {m,n}, ^, $ and \ escapes
 It supports more selection commands in one run
 Selections work with logical operator AND
+All commands are checked first, then executed in a single pass over the table
+With -j N the pass over the table is split between N threads
+With --stream the table is processed row by row, so it can be of any length
+With --stats the cost of every command is printed to stderr, if built with SHEET_STATS
+With --script FILE the table is read once and every line of FILE is a job: OUTPUT_FILE COMMANDS
+Words of the jobs are separated by spaces, "quoted words" can contain spaces, \" and \\
+With --serve SOCKET TABLE_FILE... the tables are kept in memory and the program answers requests
+sent to the unix socket, one line for every request: TABLE_FILE COMMANDS, patterns cannot be given as @FILE
+The answer is "OK LENGTH" and the table of LENGTH bytes, or "ERROR MESSAGE", both lines end with \n
+With --cache FILE the parsed table is kept in FILE and the next run with the same input file loads it from there
+Extra data command:
+sort C [asc|desc] [num|str] - selected rows are sorted by column C among themselves, the order of equal rows is kept
+With num the cells, which are not numbers, go before the numbers, with desc too
+With --sort-memory MB bigger tables are sorted in parts, which are merged from temporary files
+csum C [R D], cavg, cmin, cmax, ccount - sum, average, minimum, maximum or count of the numbers
+in column C of the selected rows, written into cell R D, or printed as the only cell of the table
+groupby K csum C - the table becomes one row for every distinct cell in column K of the selected rows,
+with the sum of their numbers in column C, the other aggregation commands can be used too
 */
 
+// fstat(), mmap() and read() are needed for reading the input
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-
-#define MAX_LINE_LENGTH 10242
-#define MAX_ROWS 200
-#define MAX_CELL_LENGTH 101
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+// SSE2 is always there on x86-64, AVX2 is used only if the processor has it
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// lazily built DFA of the matches command is shared by the threads
+#ifdef __GNUC__
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(p) (*(p))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+// counters for --stats are only in programs built with SHEET_STATS
+// otherwise the code in STATS() disappears
+#ifdef SHEET_STATS
+#define STATS(...) __VA_ARGS__
+#else
+#define STATS(...)
+#endif
+
+// stdin is read in blocks of this size
+#define READ_BLOCK_SIZE 65536
+// text of edited cells is stored in blocks of this size
+#define TEXT_BLOCK_SIZE 65536
+// output is written with writev() in pieces, short ones are copied into a buffer
+#define OUTPUT_PIECES 1024
+#define OUTPUT_BUFFER_SIZE 65536
+#define OUTPUT_COPY_LIMIT 64
 
 #define MAX_DELIMITERS 101
 #define DEFAULT_DELIMITERS " "
 
-#define NUM_COMMANDS 25
+#define NUM_COMMANDS 31
 
 #define DASH_NUMBER -1
 
+// row selection is stored in 64-bit words
+#define WORD_BITS 64
+// maximum number of threads given by -j
+#define MAX_THREADS 256
+// beginning and end of the input, which are hashed to check the cache
+#define CACHE_SAMPLE 4096
+#define CACHE_MAGIC "SHEETC01"
+
+// input shorter than this for every thread is parsed by one thread
+#define MIN_PARSE_BYTES (1 << 20)
+// connections waiting for the server to accept them
+#define SERVER_BACKLOG 64
+// smaller parts of the table are not worth a thread of their own
+#define MIN_THREAD_WORDS 64
+// the same for the parts sorted by the sort command
+#define MIN_SORT_KEYS 4096
+// and for the partitions of the groupby command
+#define MIN_GROUP_ROWS 4096
+// keys of the sort command up to this size are sorted in memory, see --sort-memory
+#define SORT_MEMORY_MB 256
+// longer numbers are not read by readDouble(), sort and aggregation commands take them as text
+#define MAX_NUMBER_LENGTH 100
+// values of the aggregation commands are added up in blocks of this size, see aggregateRows()
+#define AGGREGATE_BLOCK 4096
+// cells of the rows turned into columns at once by storeByColumns()
+#define TRANSPOSE_BLOCK 16384
+
+// states of the DFA of one regular expression, the NFA is simulated directly when they run out
+#define MAX_DFA_STATES 4096
+#define DFA_HASH_SIZE (2*MAX_DFA_STATES)
+// groups nested deeper than this are not accepted
+#define MAX_REGEX_DEPTH 1000
+// the biggest m and n of {m,n}, RE_DUP_MAX of POSIX
+#define MAX_REGEX_REPEAT 255
+// nodes added by repeating parts of the regular expression with {m,n}, longer ones are not accepted
+#define MAX_REPEAT_NODES (1 << 18)
+
+// output written to stdout or to the file of a job, see printTable()
+// pieces point into the table, the input or the buffer, until they are written by flushOutput()
+typedef struct {
+    int fd;
+    struct iovec pieces[OUTPUT_PIECES];
+    int numPieces;
+    char buffer[OUTPUT_BUFFER_SIZE];
+    size_t used;
+    // everything is copied into the buffer, in streaming mode the input changes under the pieces
+    bool copyAll;
+} output_t;
+
+// input read from stdin, the file of a table or the connection of a client
+// regular files are mapped into memory, anything else is read in blocks
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t length; // number of valid characters in buffer
+    size_t position; // first character, which was not processed yet
+    size_t capacity;
+    bool mapped;
+    bool eof;
+    // in streaming mode the rows printed so far are written, before the program waits for more input
+    output_t *output;
+} input_t;
+
+#ifdef SHEET_STATS
+// cost of one command, or of reading or printing the table
+typedef struct {
+    uint64_t nanoseconds; // with -j the time of all threads is added up
+    uint64_t rows; // rows visited
+    uint64_t lookups; // cells found by getCell()
+    uint64_t cellsWritten;
+    uint64_t cellsMoved; // rows or columns moved to another place by layout commands
+    uint64_t bytes; // text read, written into cells or printed, and bytes of the cells moved
+} stats_t;
+#endif
+
+// one cell of the table
+// the text is not terminated, it points either into the input or into the table's text blocks
+typedef struct {
+    char *text;
+    int length;
+} cell_t;
+
+// memory for text of cells, which did not fit into their original place
+// blocks never move, so cells can point into them
+typedef struct block {
+    struct block *next;
+    size_t used;
+    size_t capacity;
+    char text[];
+} block_t;
+
+// rows and columns of the table after layout commands
+// layout commands only change the view, the cells stay where they were read, see getCell()
+// the table is put together according to the view, when it is printed
+typedef struct {
+    int *rows; // row of the cells for every row of the table, 0 for a new empty row
+    int *cols; // the same for columns
+    int rowCapacity;
+    int numRows; // size of the array of cells
+    int numCols;
+} view_t;
+
 // struct for table
 // stores only one main delimiter
-// others get replaced in function readTable
-// the content of the data array is basically CSV
+// others are only used for splitting the input into cells
+// the table works like a piece table, every cell points to its text
+// so editing one cell does not move the rest of the table
 typedef struct {
-    char data[MAX_LINE_LENGTH];
+    cell_t *cells; // row after row, or column after column, see cellIndex()
+    size_t cellCapacity;
+    view_t *view; // NULL, until a layout command is used
+    bool byColumns;
+    int numRows;
+    int numCols;
+    input_t input; // original text of the cells
+    block_t *blocks; // text written into cells, the first block is the newest one
     char delimiter;
-    bool rowSelected[MAX_ROWS+1]; // index 0 is not used
+    // one bit for every row, row n is bit (n-1)%64 of word (n-1)/64
+    // allocated by selectAll()
+    uint64_t *rowSelected;
+    // number of the first row stored in the table
+    // is bigger than 1 only in streaming mode, when the previous rows were already printed
+    int firstRow;
+    // rows are read one at a time by streamTable(), the number of rows is known only at the last one
+    bool streaming;
+    bool lastRow; // in streaming mode, the row in the table is the last one
+    // first row with different number of columns than the first one, set with ERR_BAD_TABLE
+    int badRow;
+    // the input belongs to another table, see snapshotTable()
+    // cells cannot change its text in place, their new text is written into the blocks
+    bool sharedInput;
+    bool sharedCells; // the array of cells belongs to another table too, nothing can change it
+#ifdef SHEET_STATS
+    stats_t stats; // collected until the command, which caused them, takes them
+#endif
 } table_t;
 
 // always go together, easier to pass around
@@ -44,6 +241,20 @@ typedef struct {
     char **argv;
 } arguments_t;
 
+// options given before the commands
+typedef struct {
+    char delimiters[MAX_DELIMITERS];
+    bool stream;
+    bool stats;
+    int numThreads;
+    // store the table column after column, chosen according to the first command in main()
+    bool byColumns;
+    char *script; // file with jobs given by --script, NULL without it
+    char *socket; // path of the socket given by --serve, NULL without it
+    char *cache; // file with the parsed table given by --cache, NULL without it
+    size_t sortMemory; // bytes of keys of the sort command, given by --sort-memory
+} options_t;
+
 // all program states
 // these are returned by most functions that can fail in any way
 typedef enum {
@@ -51,11 +262,26 @@ typedef enum {
     NOT_FOUND,
     ERR_GENERIC,
     ERR_TOO_LONG,
+    ERR_NO_MEMORY,
+    ERR_READ,
     ERR_OUT_OF_RANGE,
     ERR_BAD_SYNTAX,
     ERR_TABLE_EMPTY,
     ERR_BAD_ORDER,
-    ERR_BAD_TABLE
+    ERR_BAD_TABLE,
+    ERR_NOT_STREAMABLE,
+    ERR_PATTERN_FILE,
+    ERR_BAD_REGEX,
+    ERR_NO_STATS,
+    ERR_WRITE,
+    ERR_SCRIPT_FILE,
+    ERR_OUTPUT_FILE,
+    ERR_JOB_FAILED,
+    ERR_SOCKET,
+    ERR_NO_TABLE,
+    ERR_SORT_FILE,
+    ERR_NO_NUMBERS,
+    ERR_FILE_REQUEST
 } state_t;
 
 // categorizes every command
@@ -67,6 +293,16 @@ typedef enum {
     SELECTION,
 } type_of_command_t;
 
+// meaning of characters in the input
+typedef enum {
+    CHAR_TEXT = 0,
+    CHAR_DELIMITER,
+    CHAR_NEWLINE
+} char_class_t;
+
+
+typedef struct step step_t;
+typedef struct plan plan_t;
 
 // always go together, easier to pass around
 typedef struct {
@@ -74,189 +310,337 @@ typedef struct {
     int numParameters;
     bool hasStringParameter;
     type_of_command_t type;
-    // pointer for every function separately
-    // what a perfect opportunity for union
+    // layout commands work with the whole table
     state_t (*fnZero)(table_t*);
     state_t (*fnOne)(table_t*, int);
     state_t (*fnTwo)(table_t*, int, int);
-    // function with one integer argument and one string
-    state_t (*fnOneStr)(table_t*, int, char*);
+    state_t (*fnStep)(table_t*, step_t*); // layout command with string parameter
+    // selection and data commands are executed in one pass over the table, see executePlan()
+    // checks the parameters against the table before the pass, may be NULL
+    state_t (*fnCheck)(table_t*, step_t*);
+    // selection: returns which of the rows in the word of the selection stay selected
+    uint64_t (*fnSelect)(table_t*, step_t*, size_t, uint64_t);
+    // data: processes one selected row
+    state_t (*fnRow)(table_t*, step_t*, int);
+    // data: processes all selected rows at once after the pass, used instead of fnRow
+    state_t (*fnTable)(table_t*, step_t*, plan_t*);
+    // reads other words behind the parameters, may be NULL
+    state_t (*fnOptions)(arguments_t*, step_t*);
+    // prepares the string parameter once for the whole plan, both may be NULL
+    state_t (*fnCompile)(step_t*, plan_t*);
+    void (*fnFree)(step_t*);
 } command_t;
 
-// checks, if the table is empty
-bool isEmpty(table_t *table) {
-    if (strcmp(table->data, "\n") <= 0)
-        return true;
+// one command with its parameters, as it was read from the arguments
+struct step {
+    command_t *command;
+    int parameters[2];
+    char *strParameter; // points into argv
+    size_t strLength;
+    int range[2]; // rows chosen by the rows command, set by checkRows()
+    void *data; // made from the string parameter by fnCompile
+#ifdef SHEET_STATS
+    stats_t stats;
+#endif
+};
+
+// all the commands from the arguments
+// the whole plan is checked before any command is executed
+struct plan {
+    step_t *steps;
+    int numSteps;
+    int numThreads; // for the pass of selection and data commands
+    size_t sortMemory; // see --sort-memory
+    // the commands came from a client of --serve, they cannot read files with the server's permissions
+    bool serving;
+#ifdef SHEET_STATS
+    bool stats; // time is measured only with --stats
+    stats_t readStats;
+    stats_t printStats;
+#endif
+};
+
+// part of the table processed by one thread, see executeParallel()
+typedef struct {
+    plan_t *plan;
+    table_t table; // copy of the table, text written by the thread goes into its own blocks
+    size_t firstWord;
+    size_t endWord;
+    state_t state;
+#ifdef SHEET_STATS
+    stats_t *stepStats; // one for every step of the plan
+#endif
+} chunk_t;
 
-    return false;
-}
+// Aho-Corasick automaton for finding many patterns in a cell at once, see buildAutomaton()
+typedef struct {
+    unsigned char byteClass[256]; // bytes, which behave the same, share a class
+    int numClasses;
+    int numStates;
+    int *next; // next state for every state and class of byte
+    int *pattern; // pattern ending in the state, or -1
+    int *outLink; // nearest state with a pattern on the way of failure links, or -1
+    bool *accept; // any pattern ends in the state
+    int numPatterns;
+    bool matchAll; // all patterns have to be found, not only one of them
+} automaton_t;
+
+// nodes of the NFA of a regular expression
+typedef enum {
+    NODE_CHAR, // reads one of the bytes in chars
+    NODE_SPLIT, // goes on both to out and out2
+    NODE_EMPTY,
+    NODE_BEGIN, // ^
+    NODE_END, // $
+    NODE_MATCH
+} node_type_t;
+
+typedef struct {
+    node_type_t type;
+    int out;
+    int out2;
+    uint64_t chars[4];
+} nfa_node_t;
+
+// state of the DFA is a set of NFA nodes
+typedef struct {
+    int *set; // sorted nodes reading a byte, matching, or waiting for the end
+    int setSize;
+    int *next; // next state for every class of byte, -1 if it was not needed yet
+    bool accept;
+    bool acceptAtEnd; // accepts, if the cell ends here
+} dfa_state_t;
+
+// regular expression of the matches command, see compileRegex()
+typedef struct {
+    nfa_node_t *nodes;
+    int numNodes;
+    int nodeCapacity;
+    int maxNodes;
+    int matchNode;
+    unsigned char byteClass[256]; // bytes, which are read by the same nodes, share a class
+    unsigned char classByte[256]; // one byte of every class
+    int numClasses;
+    dfa_state_t *states; // never moves, so the threads can read it while it grows
+    int numStates;
+    int start;
+    int *hash; // states by their sets
+    pthread_mutex_t lock; // for adding states
+    // memory used while adding states
+    char *marks;
+    char *scratchMarks;
+    int *scratchSet;
+    int *scratchStack;
+} dfa_t;
+
+// reads the regular expression into the NFA
+typedef struct {
+    const char *text;
+    size_t length;
+    size_t pos;
+    int depth;
+    dfa_t *dfa;
+    state_t state;
+} regex_parser_t;
+
+// part of the NFA with one entry and one exit, the exit is an empty node
+typedef struct {
+    int start;
+    int end;
+} fragment_t;
 
 // prints basic help on how to use the program
 void printUsage() {
     const char *usageString = "\nUsage:\n"
         "./sheet [-d DELIM] [Commands for editing the table]\n"
         "or\n"
-        "./sheet [-d DELIM] [Row selection] [Command for processing the data]\n";
+        "./sheet [-d DELIM] [-j THREADS] [--cache FILE] [Row selection] [Command for processing the data]\n"
+        "or\n"
+        "./sheet [-d DELIM] --stream [Row selection] [Command for processing the data]\n"
+        "or\n"
+        "./sheet [-d DELIM] [-j THREADS] [--cache FILE] --script FILE\n"
+        "or\n"
+        "./sheet [-d DELIM] [-j THREADS] --serve SOCKET TABLE_FILE...\n"
+        "\n--stats before the commands prints their cost, only in a build with SHEET_STATS (make STATS=1)\n";
 
     fprintf(stderr, "%s", usageString);
 }
 
-// prints error message according to the error state
-void printErrorMessage(state_t err_state) {
+// returns the message for the error state
+const char *errorMessage(state_t err_state) {
     switch(err_state) {
         case NOT_FOUND:
-            fputs("No commands found\n", stderr);
-            printUsage();
-            break;
+            return "No commands found";
 
         case ERR_GENERIC:
-            fputs("Generic error\n", stderr);
-            break;
+            return "Generic error";
 
         case ERR_TOO_LONG:
-            fputs("Maximum file size is 10kiB\n", stderr);
-            break;
+            return "Table is too long";
+
+        case ERR_NO_MEMORY:
+            return "Not enough memory";
+
+        case ERR_READ:
+            return "Cannot read the table";
 
         case ERR_OUT_OF_RANGE:
-            fputs("Given cell coordinates are out of range\n", stderr);
-            break;
+            return "Given cell coordinates are out of range";
 
         case ERR_BAD_SYNTAX:
-            fputs("Bad syntax\n", stderr);
-            break;
+            return "Bad syntax";
 
         case ERR_TABLE_EMPTY:
-            fputs("Table cannot be empty\n", stderr);
-            break;
+            return "Table cannot be empty";
 
         case ERR_BAD_ORDER:
-            fputs("Commands are used in wrong order\n", stderr);
-            printUsage();
-            break;
+            return "Commands are used in wrong order";
 
         case ERR_BAD_TABLE:
-            fputs("Table has different numbers of columns in each row\n", stderr);
-            break;
+            return "Table has different numbers of columns in each row";
+
+        case ERR_NOT_STREAMABLE:
+            return "Commands for editing the table cannot be used with --stream";
+
+        case ERR_PATTERN_FILE:
+            return "Cannot read the file with patterns";
+
+        case ERR_BAD_REGEX:
+            return "Bad regular expression";
+
+        case ERR_WRITE:
+            return "Cannot write the table";
+
+        case ERR_SCRIPT_FILE:
+            return "Cannot read the script";
+
+        case ERR_OUTPUT_FILE:
+            return "Cannot open the output file";
+
+        case ERR_JOB_FAILED:
+            return "Some jobs of the script failed";
+
+        case ERR_SOCKET:
+            return "Cannot listen on the socket";
+
+        case ERR_NO_TABLE:
+            return "There is no such table";
+
+        case ERR_SORT_FILE:
+            return "Cannot use the temporary file of sort";
+
+        case ERR_NO_NUMBERS:
+            return "There are no numbers in the selected cells";
+
+        case ERR_FILE_REQUEST:
+            return "Patterns cannot be read from a file in requests to the server";
+
+        case ERR_NO_STATS:
+            return "--stats needs a build with SHEET_STATS (make STATS=1), this one was built without it";
 
         default:
-            fputs("Unknown error\n", stderr);
-            break;
+            return "Unknown error";
     }
 }
 
-// shifts data in the array of table structure
-// the table pointer is passed only to check for buffer overflow
-state_t shiftData(char *p, int shift, table_t *table) {
-    // doesnt need any shifting
-    if (shift == 0)
-        return SUCCESS;
+// prints error message according to the error state
+void printErrorMessage(state_t err_state) {
+    fprintf(stderr, "%s\n", errorMessage(err_state));
 
-    // we have to go from beginning not to overwrite our data
-    if (shift < 0) {
-        // condition is p[i-1], because \0 also has to be copied
-        int i=0;
-        while (p[i] != '\0') {
-            p[i] = p[i-shift];
-            i++;
-        }
-        p[i-shift] = '\0';
+    // these are usually caused by wrong use of the program
+    if ((err_state == NOT_FOUND) || (err_state == ERR_BAD_ORDER))
+        printUsage();
+}
+
+// returns position of the cell in the table's array of cells
+size_t cellIndex(table_t *table, int row, int column) {
+    if (table->byColumns)
+        return (size_t)(column-1)*table->numRows + row-1;
 
+    return (size_t)(row-1)*table->numCols + column-1;
+}
+
+// makes sure the table can hold given number of cells
+state_t reserveCells(table_t *table, size_t numCells) {
+    if (numCells <= table->cellCapacity)
         return SUCCESS;
-    }
 
-    // we have to go from end
-    if (shift > 0) {
-        int lastIndex = strlen(p);
+    // grow at least twice, so that appending rows does not reallocate every time
+    size_t capacity = 2 * table->cellCapacity;
+    if (capacity < numCells)
+        capacity = numCells;
 
-        // if we expand the data, we must check for buffer overflow
-        if (&table->data[MAX_LINE_LENGTH] <= &p[lastIndex+shift]) {
-            return ERR_TOO_LONG;
-        }
+    cell_t *cells = realloc(table->cells, capacity * sizeof(cell_t));
+    if (cells == NULL)
+        return ERR_NO_MEMORY;
 
-        // then iterate through the array from the last index all the way to the first
-        for (int i=lastIndex; i>=0; i--) {
-            p[i+shift] = p[i];
-        }
-    }
+    table->cells = cells;
+    table->cellCapacity = capacity;
     return SUCCESS;
 }
 
-// Takes in character and determines
-// if it is end of cell
-int endOfCell(char p, table_t *table) {
-    if(p == table->delimiter)
-        return 1;
+// returns space for text of given length
+// or NULL pointer, if there is not enough memory
+char *allocText(table_t *table, size_t length) {
+    block_t *block = table->blocks;
+
+    if ((block == NULL) || (block->capacity - block->used < length)) {
+        // long texts get a block of their own
+        size_t capacity = TEXT_BLOCK_SIZE;
+        if (length > capacity)
+            capacity = length;
 
-    if(p == '\n')
-        return 1;
+        block = malloc(sizeof(block_t) + capacity);
+        if (block == NULL)
+            return NULL;
+
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = table->blocks;
+        table->blocks = block;
+    }
 
-    if(p == '\0')
-        return 1;
+    char *text = &block->text[block->used];
+    block->used += length;
+    return text;
+}
 
-    return 0;
+// frees text of all cells written by setCellText()
+void freeText(table_t *table) {
+    while (table->blocks != NULL) {
+        block_t *next = table->blocks->next;
+        free(table->blocks);
+        table->blocks = next;
+    }
 }
 
 // returns number of table's rows
 int countRows(table_t *table) {
-    int rows = 0;
-    char c; // current character
-
-    int i = 0;
-    while ((c = table->data[i]) != '\0') {
-        if (c == '\n') {
-            rows++;
-        }
-        i++;
-    }
-    return rows;
+    return table->numRows;
 }
 
 // returns number of table's columns
 int countColumns(table_t *table) {
-    int columns = 1;
-
-    char c; // current character
-
-    int i=0;
-    while ((c = table->data[i]) != '\n') {
-        if (c == table->delimiter) {
-            columns++;
-        }
-        i++;
-    }
-    return columns;
+    return table->numCols;
 }
 
-int isConsistent(table_t *table) {
-    int numCols = -1; // not set, gets set after the first row and then stays constant
-    int col = 1; // current column
-
-    char c; // current character
+cell_t *getCell(table_t *table, int row, int column);
 
-    for (int i=0; (c = table->data[i]) != '\0'; i++) {
-
-        if (c == table->delimiter) {
-            col++;
-        }
-
-        if (c == '\n') {
-            if (numCols == -1)
-                numCols = col;
+// checks, if the table is empty
+bool isEmpty(table_t *table) {
+    if (table->numRows == 0)
+        return true;
 
-            if (col != numCols)
-                return false;
+    // table with only one empty cell
+    if ((table->numRows == 1) && (table->numCols == 1) && (getCell(table, 1, 1)->length == 0))
+        return true;
 
-            col = 1;
-        }
-    }
-    return true;
+    return false;
 }
 
 // Takes argc and argv parameters from main
 // Writes the delimiters into delimiters array
 state_t readDelimiters(arguments_t *args, char delimiters[]) {
-    strcpy(delimiters, DEFAULT_DELIMITERS);
-
     if (args->argc < 2) {
         return NOT_FOUND;
     }
@@ -271,670 +655,4837 @@ state_t readDelimiters(arguments_t *args, char delimiters[]) {
     return SUCCESS;
 }
 
-// Reads table from stdin and saves it into the table structure
-// The function also reads delimiters from arguments
-// Returns program state
-state_t readTable(arguments_t *args, table_t *table) {
+// Reads the number of threads given as -j N
+state_t readThreads(arguments_t *args, int *numThreads) {
+    if ((args->index + 1 >= args->argc) || (strcmp(args->argv[args->index], "-j") != 0))
+        return NOT_FOUND;
 
-    char delimiters[MAX_DELIMITERS];
-    readDelimiters(args, delimiters);
+    char *pEnd;
+    long n = strtol(args->argv[args->index + 1], &pEnd, 10);
+    if ((*pEnd != '\0') || (n < 1) || (n > MAX_THREADS))
+        return ERR_BAD_SYNTAX;
 
-    // set the table's main delimiter
-    table->delimiter = delimiters[0];
+    *numThreads = n;
+    args->index += 2;
+    return SUCCESS;
+}
 
-    char c; // scanned character
+// reads --sort-memory MB
+state_t readSortMemory(arguments_t *args, size_t *sortMemory) {
+    if ((args->index + 1 >= args->argc) || (strcmp(args->argv[args->index], "--sort-memory") != 0))
+        return NOT_FOUND;
 
-    int i;
-    for (i=0; scanf("%c", &c) != EOF; i++) {
-        if(i+1 >= MAX_LINE_LENGTH) {
-            return ERR_TOO_LONG;
+    char *pEnd;
+    long n = strtol(args->argv[args->index + 1], &pEnd, 10);
+    if ((*pEnd != '\0') || (n < 1) || ((unsigned long)n > SIZE_MAX >> 20))
+        return ERR_BAD_SYNTAX;
+
+    *sortMemory = (size_t)n << 20;
+    args->index += 2;
+    return SUCCESS;
+}
+
+// Reads all options in front of the commands
+// they can be given in any order
+void readOptions(arguments_t *args, options_t *options) {
+    strcpy(options->delimiters, DEFAULT_DELIMITERS);
+    options->stream = false;
+    options->stats = false;
+    options->numThreads = 1;
+    options->byColumns = false;
+    options->script = NULL;
+    options->socket = NULL;
+    options->cache = NULL;
+    options->sortMemory = (size_t)SORT_MEMORY_MB << 20;
+
+    while (args->index < args->argc) {
+        if (readDelimiters(args, options->delimiters) == SUCCESS)
+            continue;
+
+        // wrong number of threads is left for the commands, where it is bad syntax
+        if (readThreads(args, &options->numThreads) == SUCCESS)
+            continue;
+        if (readSortMemory(args, &options->sortMemory) == SUCCESS)
+            continue;
+
+        if (strcmp(args->argv[args->index], "--stream") == 0) {
+            options->stream = true;
+            args->index++;
+            continue;
         }
 
-        // if scanned character is delimiter
-        if (strchr(delimiters, c)) {
-            // only main delimiter is stored in memory
-            table->data[i] = delimiters[0];
+        if (strcmp(args->argv[args->index], "--stats") == 0) {
+            options->stats = true;
+            args->index++;
             continue;
         }
 
-        table->data[i] = c;
-    }
+        if ((strcmp(args->argv[args->index], "--cache") == 0) && (args->index + 1 < args->argc)) {
+            options->cache = args->argv[args->index + 1];
+            args->index += 2;
+            continue;
+        }
 
-    // fix faulty csv files
-    // in memory there will be exactly one \n at the end
-    table->data[i++] = '\n';
-    // go back until there is exactly one \n left
-    while (table->data[i-2] == '\n')
-        i--;
-    // write string termination charater
-    table->data[i] = '\0';
+        if ((strcmp(args->argv[args->index], "--serve") == 0) && (args->index + 1 < args->argc)) {
+            options->socket = args->argv[args->index + 1];
+            args->index += 2;
+            continue;
+        }
 
-    if (isConsistent(table))
-        return SUCCESS;
+        if ((strcmp(args->argv[args->index], "--script") == 0) && (args->index + 1 < args->argc)) {
+            options->script = args->argv[args->index + 1];
+            args->index += 2;
+            continue;
+        }
 
-    return ERR_BAD_TABLE;
+        // first argument, which is not an option
+        break;
+    }
 }
 
-// returns pointer to first character of the cell
-// or NULL pointer, if coordinates are invalid
-char *getCellPtr(int row, int column, table_t *table) {
-    // check for bad coordinaters
-    if ((row<1) || (column<1)) {
-        return NULL;
+// sets the table up, so that it can be filled by readTable() or streamTable()
+void initTable(table_t *table, char delimiter) {
+    table->cells = NULL;
+    table->cellCapacity = 0;
+    table->view = NULL;
+    table->byColumns = false;
+    table->numRows = 0;
+    table->numCols = 0;
+    table->input = (input_t){.fd=STDIN_FILENO};
+    table->blocks = NULL;
+    table->delimiter = delimiter;
+    table->rowSelected = NULL;
+    table->firstRow = 1;
+    table->streaming = false;
+    table->lastRow = false;
+    table->badRow = 0;
+    table->sharedInput = false;
+    table->sharedCells = false;
+    STATS(table->stats = (stats_t){0};)
+}
+
+// frees memory of the input
+void freeInput(input_t *input) {
+    if (input->mapped)
+        munmap(input->buffer, input->capacity);
+    else
+        free(input->buffer);
+}
+
+// frees memory allocated for the table
+void freeTable(table_t *table) {
+    if (!table->sharedCells)
+        free(table->cells);
+    if (table->view != NULL) {
+        free(table->view->rows);
+        free(table->view->cols);
+        free(table->view);
     }
+    freeText(table);
+    if (!table->sharedInput)
+        freeInput(&table->input);
+    free(table->rowSelected);
+    initTable(table, table->delimiter);
+}
 
-    int currentRow = 1;
-    int currentColumn = 1;
-    int currentCharacter = 0;
+// Fills the table, which says what every character of the input means
+// all characters from delimiters separate cells, \n separates rows
+void buildCharClasses(const char *delimiters, unsigned char classes[256]) {
+    memset(classes, CHAR_TEXT, 256);
+    classes['\n'] = CHAR_NEWLINE;
 
-    // increment currentCharacter until both rowsrowsrowsrowsrowsrowsrows and colums are reached
-    while ((currentRow<row) || (currentColumn<column)) {
-        char c = table->data[currentCharacter];
+    // delimiters used to be replaced by the first one, so they all end rows, if it is \n
+    unsigned char delimiterClass = (delimiters[0] == '\n') ? CHAR_NEWLINE : CHAR_DELIMITER;
 
-        if (c == table->delimiter)
-            currentColumn++;
+    for (int i=0; delimiters[i] != '\0'; i++)
+        classes[(unsigned char)delimiters[i]] = delimiterClass;
 
-        // end of line
-        if (c == '\n') {
-            // (n+1)st column is located there
-            currentColumn++;
-            if ((currentRow == row) && (currentColumn == column))
-                break;
+    // \0 is part of every string, so it has always been treated as delimiter
+    classes[0] = delimiterClass;
+}
 
-            // move onto the next row
-            currentRow++;
-            currentColumn = 1;
+// writes all pieces of the output to its file
+state_t flushOutput(output_t *output) {
+    struct iovec *piece = output->pieces;
+    int numPieces = output->numPieces;
+
+    while (numPieces > 0) {
+        ssize_t written = writev(output->fd, piece, numPieces);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return ERR_WRITE;
         }
 
-        // end of table
-        if (c == '\0')
-            return NULL;
-
-        currentCharacter++;
+        // pieces written whole are skipped, the next one may be written only partly
+        while ((numPieces > 0) && ((size_t)written >= piece->iov_len)) {
+            written -= piece->iov_len;
+            piece++;
+            numPieces--;
+        }
+        if (numPieces > 0) {
+            piece->iov_base = (char *)piece->iov_base + written;
+            piece->iov_len -= written;
+        }
     }
 
-    return &(table->data[currentCharacter]);
+    output->numPieces = 0;
+    output->used = 0;
+    return SUCCESS;
 }
 
+// Reads next block of the input into its buffer
+// the characters, which were already processed, are thrown away
+state_t fillInput(input_t *input) {
+    if (input->output != NULL) {
+        state_t state = flushOutput(input->output);
+        if (state != SUCCESS)
+            return state;
+    }
 
-// reads string from table's cell
-state_t readCell(table_t *table, int row, int column, char *content) {
-    if (column<1 || column>countColumns(table))
-        return ERR_OUT_OF_RANGE;
+    // move the unprocessed characters to the beginning
+    input->length -= input->position;
+    if (input->length > 0)
+        memmove(input->buffer, &input->buffer[input->position], input->length);
+    input->position = 0;
 
-    char *cellPtr = getCellPtr(row, column, table);
+    if (input->length + READ_BLOCK_SIZE > input->capacity) {
+        size_t capacity = 2*input->capacity;
+        if (capacity < input->length + READ_BLOCK_SIZE)
+            capacity = input->length + READ_BLOCK_SIZE;
 
-    // should never happen, but just to make sure
-    if (cellPtr == NULL)
-        return ERR_GENERIC;
+        char *buffer = realloc(input->buffer, capacity);
+        if (buffer == NULL)
+            return ERR_NO_MEMORY;
 
-    int i=0;
-    while (!endOfCell(cellPtr[i], table)) {
-        content[i] = cellPtr[i];
-        i++;
+        input->buffer = buffer;
+        input->capacity = capacity;
+    }
+
+    ssize_t n;
+    do {
+        n = read(input->fd, &input->buffer[input->length], input->capacity - input->length);
+    } while ((n < 0) && (errno == EINTR));
+
+    if (n < 0)
+        return ERR_READ;
+
+    if (n == 0)
+        input->eof = true;
+
+    input->length += n;
+    return SUCCESS;
+}
+
+// Loads the whole input into memory
+// regular files are mapped, other inputs are read block by block
+state_t loadInput(input_t *input) {
+    struct stat st;
+
+    if ((fstat(input->fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        // stdin does not have to be at the beginning of the file
+        off_t offset = lseek(input->fd, 0, SEEK_CUR);
+        // private mapping can be written to, cells are edited in place
+        void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, input->fd, 0);
+
+        if ((offset >= 0) && (offset <= st.st_size) && (p != MAP_FAILED)) {
+            input->buffer = p;
+            input->length = st.st_size;
+            input->position = offset;
+            input->capacity = st.st_size;
+            input->mapped = true;
+            input->eof = true;
+            return SUCCESS;
+        }
+
+        if (p != MAP_FAILED)
+            munmap(p, st.st_size);
     }
-    content[i] = '\0';
 
+    while (!input->eof) {
+        state_t state = fillInput(input);
+        if (state != SUCCESS)
+            return state;
+    }
     return SUCCESS;
 }
 
-// writes passed string into chosen cell in table
-state_t writeCell(table_t *table, int row, int column, char* content) {
-    if (column<1 || column>countColumns(table))
-        return ERR_OUT_OF_RANGE;
+// Splits the text into rows and cells and appends them to the table
+// the last row does not end with \n, cells point directly into the text
+// Returns ERR_BAD_TABLE, if the rows have different numbers of columns
+state_t parseRows(table_t *table, const unsigned char classes[256], char *text, size_t length) {
+    size_t numCells = (size_t)table->numRows * table->numCols;
+    size_t rowStart = numCells; // first cell of the current row
+    size_t start = 0; // first character of the current cell
+
+    for (size_t i=0; i<=length; i++) {
+        // end of the text ends the last row
+        unsigned char class = (i < length) ? classes[(unsigned char)text[i]] : CHAR_NEWLINE;
+        if (class == CHAR_TEXT)
+            continue;
 
-    char *cellPtr = getCellPtr(row, column, table);
+        if (numCells == table->cellCapacity) {
+            state_t state = reserveCells(table, numCells + 1);
+            if (state != SUCCESS)
+                return state;
+        }
 
-    if (cellPtr == NULL)
-        return ERR_GENERIC;
+        if ((i - start > INT_MAX) || (table->numRows == INT_MAX))
+            return ERR_TOO_LONG;
 
-    // calculate length of both old and new cells
-    int newCellLength = strlen(content);
+        table->cells[numCells++] = (cell_t){.text = &text[start], .length = i - start};
+        start = i+1;
 
-    int oldCellLength=0;
-    while (!endOfCell(cellPtr[oldCellLength], table))
-        oldCellLength++;
+        if (class == CHAR_NEWLINE) {
+            // number of columns is set by the first row and then stays constant
+            int numCols = numCells - rowStart;
+            if (table->numCols == 0)
+                table->numCols = numCols;
 
-    // how many characters to expand (can be negative)
-    int shift = newCellLength - oldCellLength;
+            if (numCols != table->numCols) {
+                table->badRow = table->firstRow + table->numRows;
+                return ERR_BAD_TABLE;
+            }
 
-    state_t s = shiftData(cellPtr, shift, table);
-    if (s != SUCCESS) {
-        return s;
+            table->numRows++;
+            rowStart = numCells;
+        }
     }
+    return SUCCESS;
+}
+
+// copies the cells of the table stored by rows column after column
+void copyByColumns(table_t *table, cell_t *cells) {
+    int numRows = countRows(table);
+    int numCols = countColumns(table);
 
-    for (int i=0; i<newCellLength; i++) {
-        cellPtr[i] = content[i];
+    // rows are read one after another, every column is written at its own place
+    size_t i = 0;
+    for (int row=0; row<numRows; row++) {
+        for (int col=0; col<numCols; col++)
+            cells[(size_t)col*numRows + row] = table->cells[i++];
     }
+}
+
+// changes the number of cells the table can hold, used to give back the space, which is not needed
+state_t resizeCells(table_t *table, size_t numCells) {
+    cell_t *cells = realloc(table->cells, numCells * sizeof(cell_t));
+    if (cells == NULL)
+        return (numCells < table->cellCapacity) ? SUCCESS : ERR_NO_MEMORY;
 
+    table->cells = cells;
+    table->cellCapacity = numCells;
     return SUCCESS;
 }
 
-// inserts an empty row into the table
-state_t irow(table_t *table, int row) {
-    if (row < 1 || row > countRows(table)+1) {
-        return ERR_OUT_OF_RANGE;
+// Rearranges the cells, so that every column is stored in one piece
+// data and selection commands then go through one dense array of cells
+// layout commands work only with tables stored by rows
+// the cells are moved in place, a second array would double the memory:
+// every block of rows is turned into parts of columns, then the parts are moved to their columns
+state_t storeByColumns(table_t *table) {
+    size_t numRows = countRows(table);
+    size_t numCols = countColumns(table);
+
+    // one row or one column is stored the same way
+    if ((numRows <= 1) || (numCols <= 1)) {
+        table->byColumns = true;
+        return SUCCESS;
     }
 
-    int numColumns = countColumns(table);
+    size_t blockRows = TRANSPOSE_BLOCK / numCols;
+    if (blockRows == 0)
+        blockRows = 1;
+    if (blockRows > numRows)
+        blockRows = numRows;
+
+    // the last block is filled up with empty rows, they are cut off the columns at the end
+    size_t numBlocks = (numRows + blockRows - 1) / blockRows;
+    size_t paddedRows = numBlocks * blockRows;
+    state_t state = resizeCells(table, paddedRows * numCols);
+    if (state != SUCCESS)
+        return state;
+
+    // the buffer holds one block, at least two parts of columns
+    cell_t *buffer = malloc(blockRows * numCols * sizeof(cell_t));
+    // one bit for every part of a column, which is already at its place
+    uint64_t *moved = calloc(numBlocks*numCols/64 + 1, sizeof(uint64_t));
+    if ((buffer == NULL) || (moved == NULL)) {
+        free(buffer);
+        free(moved);
+        return ERR_NO_MEMORY;
+    }
 
-    char *p = getCellPtr(row, 1, table);
+    cell_t *cells = table->cells;
+    memset(&cells[numRows * numCols], 0, (paddedRows - numRows) * numCols * sizeof(cell_t));
 
-    state_t s = shiftData(p, numColumns, table);
-    if (s != SUCCESS) {
-        return s;
+    for (size_t block=0; block<numBlocks; block++) {
+        cell_t *rows = &cells[block * blockRows * numCols];
+        memcpy(buffer, rows, blockRows * numCols * sizeof(cell_t));
+        for (size_t row=0; row<blockRows; row++) {
+            for (size_t col=0; col<numCols; col++)
+                rows[col*blockRows + row] = buffer[row*numCols + col];
+        }
     }
 
-    for (int i=0; i<numColumns-1; i++) {
-        p[i] = table->delimiter;
+    // part i is column i%numCols of block i/numCols, it goes where the part of the cycle was
+    size_t numParts = numBlocks * numCols;
+    size_t partSize = blockRows * sizeof(cell_t);
+    cell_t *carried = buffer;
+    cell_t *next = &buffer[blockRows];
+    for (size_t start=0; start<numParts; start++) {
+        if (moved[start/64] & ((uint64_t)1 << start%64))
+            continue;
+
+        memcpy(carried, &cells[start * blockRows], partSize);
+        size_t i = start;
+        do {
+            i = (i % numCols) * numBlocks + i / numCols;
+            memcpy(next, &cells[i * blockRows], partSize);
+            memcpy(&cells[i * blockRows], carried, partSize);
+            moved[i/64] |= (uint64_t)1 << i%64;
+
+            cell_t *swap = carried;
+            carried = next;
+            next = swap;
+        } while (i != start);
     }
-    p[numColumns-1] = '\n';
 
-    return SUCCESS;
-}
+    // columns are moved over the empty rows behind the ones before them
+    for (size_t col=1; col<numCols; col++)
+        memmove(&cells[col * numRows], &cells[col * paddedRows], numRows * sizeof(cell_t));
 
-// appends an empty row to the table
-state_t arow(table_t *table) {
-    return irow(table, countRows(table)+1);
+    free(buffer);
+    free(moved);
+    table->byColumns = true;
+    return resizeCells(table, numRows * numCols);
 }
 
-// deletes a row from the table
-state_t drow(table_t *table, int row) {
-    if (row < 1 || row > countRows(table))
-        return ERR_OUT_OF_RANGE;
+// beginning of the file written by --cache, see writeCache()
+// it is followed by the position of every row in the input (uint64_t) and the length of every cell (uint32_t)
+// every cell is followed by one delimiter or \n, so that is all needed to find the cells again
+typedef struct {
+    char magic[8];
+    // the input file, which the cache was made from
+    uint64_t size;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    uint64_t inode;
+    uint64_t device;
+    uint64_t position; // where stdin started in the file
+    uint64_t length; // of the text without the empty rows at the end
+    uint64_t hash; // of the beginning and the end of the text, see hashSample()
+    int32_t numRows;
+    int32_t numCols;
+    char delimiters[MAX_DELIMITERS];
+} cache_header_t;
 
-    char *p = getCellPtr(row, 1, table);
+// part of the input parsed by one thread, see parseParallel()
+typedef struct {
+    const unsigned char *classes;
+    char *text;
+    size_t length;
+    table_t table; // only rows of the part
+    state_t state;
+} parse_chunk_t;
 
-    // count how many characters have to be shifted out
-    int i = 0;
-    while (p[i++] != '\n');
+// function run by the threads parsing the input
+void *parseChunk(void *arg) {
+    parse_chunk_t *chunk = arg;
+    chunk->state = parseRows(&chunk->table, chunk->classes, chunk->text, chunk->length);
+    return NULL;
+}
 
-    shiftData(p, -i, table);
+// Splits the text into parts at ends of rows and parses them at the same time
+// every part checks its own rows, then the parts are joined one after another,
+// so the error of the first bad row is returned
+state_t parseParallel(table_t *table, const unsigned char classes[256], char *text, size_t length, int numThreads) {
+    parse_chunk_t chunks[numThreads];
+    pthread_t threads[numThreads];
+    bool started[numThreads];
+
+    // every part starts behind the \n, where the previous one ends
+    int numChunks = 0;
+    size_t start = 0;
+    for (int i=1; (i<=numThreads) && (start <= length); i++) {
+        size_t end = length;
+        if (i < numThreads) {
+            end = (length / numThreads) * i;
+            if (end < start)
+                end = start;
+            while ((end < length) && (classes[(unsigned char)text[end]] != CHAR_NEWLINE))
+                end++;
+        }
 
-    return SUCCESS;
-}
+        parse_chunk_t *chunk = &chunks[numChunks++];
+        chunk->classes = classes;
+        chunk->text = &text[start];
+        chunk->length = end - start;
+        chunk->state = SUCCESS;
+        initTable(&chunk->table, table->delimiter);
+        start = end + 1;
+    }
 
-// deletes multiple rows from the table
-state_t drows(table_t *table, int m, int n) {
-    if (n < m)
-        return ERR_BAD_SYNTAX;
+    for (int i=0; i<numChunks; i++)
+        started[i] = (i > 0) && (pthread_create(&threads[i], NULL, &parseChunk, &chunks[i]) == 0);
 
-    for (int i=m; i<=n; i++) {
-        state_t s = drow(table, m);
-        if (s != SUCCESS)
-            return s;
+    for (int i=0; i<numChunks; i++) {
+        if (!started[i])
+            parseChunk(&chunks[i]);
     }
 
-    return SUCCESS;
-}
+    size_t numCells = 0;
+    for (int i=0; i<numChunks; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        numCells += (size_t)chunks[i].table.numRows * chunks[i].table.numCols;
+    }
 
-// inserts an empty column into the table
-state_t icol(table_t *table, int col) {
-    state_t state;
+    state_t state = reserveCells(table, numCells);
+    for (int i=0; (i<numChunks) && (state == SUCCESS); i++) {
+        table_t *part = &chunks[i].table;
 
-    if (col < 1 || col > countColumns(table)+1)
-        return ERR_OUT_OF_RANGE;
+        // the first row of the part has to match the first row of the table
+        if ((i > 0) && (part->numCols != 0) && (part->numCols != table->numCols)) {
+            table->badRow = table->numRows + 1;
+            state = ERR_BAD_TABLE;
+            break;
+        }
 
-    int numRows = countRows(table);
+        if (part->numRows > INT_MAX - table->numRows) {
+            state = ERR_TOO_LONG;
+            break;
+        }
 
-    // for each row
-    for (int i=1; i<=numRows; i++) {
-        char *p = getCellPtr(i, col, table);
-        state = shiftData(p, 1, table);
-        *p = table->delimiter;
+        // rows in front of an error are kept, like parseRows() does
+        memcpy(&table->cells[(size_t)table->numRows * part->numCols], part->cells,
+            (size_t)part->numRows * part->numCols * sizeof(cell_t));
+        if (part->numCols != 0)
+            table->numCols = part->numCols;
+        if (chunks[i].state == ERR_BAD_TABLE)
+            table->badRow = table->numRows + part->badRow;
+        table->numRows += part->numRows;
+        state = chunks[i].state;
+
+        // the parts are not kept until the end, all of them together are as big as the table
+        free(part->cells);
+        part->cells = NULL;
     }
 
+    // cells of the parts point into the text of the table, only the arrays are freed
+    for (int i=0; i<numChunks; i++)
+        free(chunks[i].table.cells);
     return state;
 }
 
-// appends an empty column to the table
-state_t acol(table_t *table) {
-    return icol(table, countColumns(table)+1);
+// FNV-1a hash of CACHE_SAMPLE characters at the beginning and at the end of the text
+// the whole text is not hashed, it would take as long as parsing it
+uint64_t hashSample(const char *text, size_t length) {
+    uint64_t hash = 14695981039346656037u;
+    size_t sample = (length < CACHE_SAMPLE) ? length : CACHE_SAMPLE;
+
+    for (size_t i=0; i<sample; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211u;
+    for (size_t i=length-sample; i<length; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211u;
+    return hash;
 }
 
-// deletes a column from the table
-state_t dcol(table_t *table, int col) {
-    state_t state;
+// fills the header, which describes the input of the table
+// returns false, if the input is not a regular file, so the cache cannot be checked
+bool makeCacheHeader(options_t *options, table_t *table, size_t length, cache_header_t *header) {
+    struct stat st;
+    if (!table->input.mapped || (fstat(table->input.fd, &st) != 0) || !S_ISREG(st.st_mode))
+        return false;
 
-    if (col < 1 || col > countColumns(table))
-        return ERR_OUT_OF_RANGE;
+    // padding is written to the file too
+    memset(header, 0, sizeof(cache_header_t));
+    memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+    header->size = st.st_size;
+    header->mtimeSec = st.st_mtim.tv_sec;
+    header->mtimeNsec = st.st_mtim.tv_nsec;
+    header->inode = st.st_ino;
+    header->device = st.st_dev;
+    header->position = table->input.position;
+    header->length = length;
+    header->hash = hashSample(&table->input.buffer[table->input.position], length);
+    header->numRows = table->numRows;
+    header->numCols = table->numCols;
+    strcpy(header->delimiters, options->delimiters);
+    return true;
+}
 
-    if (countColumns(table) == 1)
-        return ERR_TABLE_EMPTY;
+// Loads the cells of the table from the cache, instead of parsing the text
+// Returns NOT_FOUND, if there is no cache or it was made from another input
+state_t loadCache(options_t *options, table_t *table, char *text, size_t length) {
+    cache_header_t expected;
+    if (!makeCacheHeader(options, table, length, &expected))
+        return NOT_FOUND;
 
-    int numRows = countRows(table);
+    int fd = open(options->cache, O_RDONLY);
+    if (fd < 0)
+        return NOT_FOUND;
 
-    // for each row
-    for (int i=1; i<=numRows; i++) {
-        char *p = getCellPtr(i, col, table);
+    struct stat st;
+    void *p = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && ((size_t)st.st_size >= sizeof(cache_header_t)))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NOT_FOUND;
 
-        int j=0;
-        while (!endOfCell(p[j], table))
-            j++;
-        // pointer will be at delimiter or \n
+    // the numbers of rows and columns are taken from the cache, the rest has to be the same
+    cache_header_t *header = p;
+    expected.numRows = header->numRows;
+    expected.numCols = header->numCols;
 
-        // if is is the last column, delimiter in front of the column will be deleted
-        if (p[j] == table->delimiter)
-            state = shiftData(p, -(j+1), table);
-        else
-            state = shiftData(&p[-1], -(j+1), table);
+    size_t numRows = (header->numRows > 0) ? header->numRows : 0;
+    size_t numCols = (header->numCols > 0) ? header->numCols : 0;
+    size_t numCells = numRows * numCols;
+    uint64_t *rowStarts = (uint64_t *)(header + 1);
+    uint32_t *lengths = (uint32_t *)(rowStarts + numRows);
 
+    state_t state = NOT_FOUND;
+    if ((memcmp(header, &expected, sizeof(cache_header_t)) == 0) && (numCols > 0)
+            && ((size_t)st.st_size == sizeof(cache_header_t) + numRows*sizeof(uint64_t) + numCells*sizeof(uint32_t)))
+        state = reserveCells(table, numCells);
 
-        if (state != SUCCESS)
-            return state;
+    if (state == SUCCESS) {
+        table->numRows = numRows;
+        table->numCols = numCols;
+        table->byColumns = options->byColumns;
+
+        // cells are checked not to get out of the text, if the cache is broken
+        for (size_t row=0; (row<numRows) && (state == SUCCESS); row++) {
+            uint64_t start = rowStarts[row];
+            for (size_t col=0; col<numCols; col++) {
+                uint32_t cellLength = lengths[row*numCols + col];
+                if ((cellLength > INT_MAX) || (start > length) || (cellLength > length - start)) {
+                    state = NOT_FOUND;
+                    break;
+                }
+
+                table->cells[cellIndex(table, row+1, col+1)] = (cell_t){.text = &text[start], .length = cellLength};
+                start += cellLength + 1;
+            }
+        }
+
+        if (state != SUCCESS) {
+            table->numRows = 0;
+            table->numCols = 0;
+            table->byColumns = false;
+        }
     }
+
+    munmap(p, st.st_size);
     return state;
 }
 
+// Writes the cells of the table, which was just parsed, into the cache
+// the cache only makes the next run faster, so it is not an error, if it cannot be written
+void writeCache(options_t *options, table_t *table, size_t length) {
+    cache_header_t header;
+    if (!makeCacheHeader(options, table, length, &header))
+        return;
 
-// deletes multiple columns from the table
+    // other programs never see a half written cache
+    char name[strlen(options->cache) + 32];
+    sprintf(name, "%s.%ld.tmp", options->cache, (long)getpid());
+
+    FILE *file = fopen(name, "wb");
+    if (file == NULL)
+        return;
+
+    const char *text = &table->input.buffer[table->input.position];
+    int numCols = countColumns(table);
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+    // numbers are written in blocks, not one by one
+    uint64_t starts[1024];
+    int numStarts = 0;
+    for (int row=1; ok && (row<=countRows(table)); row++) {
+        starts[numStarts++] = table->cells[cellIndex(table, row, 1)].text - text;
+        if ((numStarts == 1024) || (row == countRows(table))) {
+            ok = (fwrite(starts, sizeof(uint64_t), numStarts, file) == (size_t)numStarts);
+            numStarts = 0;
+        }
+    }
+
+    uint32_t lengths[2048];
+    size_t numCells = (size_t)countRows(table) * numCols;
+    for (size_t i=0; ok && (i<numCells); i += 2048) {
+        size_t numLengths = (numCells - i < 2048) ? numCells - i : 2048;
+        for (size_t k=0; k<numLengths; k++)
+            lengths[k] = table->cells[i+k].length;
+        ok = (fwrite(lengths, sizeof(uint32_t), numLengths, file) == numLengths);
+    }
+
+    if ((fclose(file) != 0) || !ok || (rename(name, options->cache) != 0))
+        remove(name);
+}
+
+// Reads table from the file descriptor and saves it into the table structure
+// Returns program state
+state_t readTable(options_t *options, table_t *table, int fd) {
+    // set the table's main delimiter
+    initTable(table, options->delimiters[0]);
+    table->input.fd = fd;
+
+    unsigned char classes[256];
+    buildCharClasses(options->delimiters, classes);
+
+    state_t state = loadInput(&table->input);
+    if (state != SUCCESS)
+        return state;
+
+    char *text = &table->input.buffer[table->input.position];
+    size_t length = table->input.length - table->input.position;
+
+    // fix faulty csv files, empty rows at the end are left out
+    while ((length > 0) && (classes[(unsigned char)text[length-1]] == CHAR_NEWLINE))
+        length--;
+
+    // every thread gets at least MIN_PARSE_BYTES
+    int numThreads = options->numThreads;
+    if ((size_t)numThreads > length / MIN_PARSE_BYTES)
+        numThreads = length / MIN_PARSE_BYTES;
+
+    // the cache makes parsing unnecessary, if it was made from the same input
+    if ((options->cache != NULL) && (loadCache(options, table, text, length) == SUCCESS))
+        return SUCCESS;
+
+    if (numThreads > 1)
+        state = parseParallel(table, classes, text, length, numThreads);
+    else
+        state = parseRows(table, classes, text, length);
+
+    if ((state == SUCCESS) && (options->cache != NULL))
+        writeCache(options, table, length);
+
+    if ((state == SUCCESS) && options->byColumns)
+        state = storeByColumns(table);
+
+    return state;
+}
+
+// Makes sure the whole next row is in the input buffer
+// length is set to the number of row's characters including \n, 0 at the end of input
+state_t nextRow(input_t *input, const unsigned char classes[256], size_t *length) {
+    size_t i = input->position;
+
+    while (true) {
+        for (; i < input->length; i++) {
+            if (classes[(unsigned char)input->buffer[i]] == CHAR_NEWLINE) {
+                *length = i+1 - input->position;
+                return SUCCESS;
+            }
+        }
+
+        // last row does not have to end with \n
+        if (input->eof) {
+            *length = input->length - input->position;
+            return SUCCESS;
+        }
+
+        // the row continues in the next block
+        i -= input->position;
+        state_t state = fillInput(input);
+        if (state != SUCCESS)
+            return state;
+        i += input->position;
+    }
+}
+
+// cell of rows and columns inserted by layout commands
+// it is never changed, data commands cannot be used after layout commands
+cell_t emptyCell = {.text = "", .length = 0};
+
+// returns pointer to the cell
+// or NULL pointer, if coordinates are invalid
+cell_t *getCell(table_t *table, int row, int column) {
+    // check for bad coordinaters
+    if ((row<1) || (column<1) || (row>table->numRows) || (column>table->numCols)) {
+        return NULL;
+    }
+
+    STATS(table->stats.lookups++;)
+
+    view_t *view = table->view;
+    if (view != NULL) {
+        row = view->rows[row-1];
+        column = view->cols[column-1];
+        if ((row == 0) || (column == 0))
+            return &emptyCell;
+
+        if (table->byColumns)
+            return &table->cells[(size_t)(column-1)*view->numRows + row-1];
+        return &table->cells[(size_t)(row-1)*view->numCols + column-1];
+    }
+
+    return &table->cells[cellIndex(table, row, column)];
+}
+
+// checks, if the cell's text is in the input
+bool isInputText(table_t *table, cell_t *cell) {
+    uintptr_t begin = (uintptr_t)table->input.buffer;
+    uintptr_t end = begin + table->input.length;
+    return (begin != 0) && ((uintptr_t)cell->text >= begin) && ((uintptr_t)cell->text + cell->length <= end);
+}
+
+// sets text of the cell
+// the old text gets overwritten, if the new one fits in its place and is not shared with other tables
+state_t setCellText(table_t *table, cell_t *cell, const char *text, int length) {
+    bool shared = table->sharedInput && isInputText(table, cell);
+    if ((length > cell->length) || (shared && (length > 0))) {
+        char *newText = allocText(table, length);
+        if (newText == NULL)
+            return ERR_NO_MEMORY;
+
+        cell->text = newText;
+    }
+
+    // text can be the cell's own text
+    memmove(cell->text, text, length);
+    cell->length = length;
+
+    STATS(table->stats.cellsWritten++;)
+    STATS(table->stats.bytes += length;)
+
+    return SUCCESS;
+}
+
+#ifdef SHEET_STATS
+// counts rows or columns of the view moved by layout commands
+void countMoved(table_t *table, size_t numMoved) {
+    table->stats.cellsMoved += numMoved;
+    table->stats.bytes += numMoved * sizeof(int);
+}
+
+// returns time for measuring the commands, only with --stats
+uint64_t startStats(plan_t *plan) {
+    if (!plan->stats)
+        return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+// adds the time since start, the rows and counters of the table to the stats
+// counters of the table start again from zero
+void stopStats(plan_t *plan, table_t *table, stats_t *stats, uint64_t start, uint64_t rows) {
+    if (plan->stats)
+        stats->nanoseconds += startStats(plan) - start;
+
+    stats->rows += rows;
+    stats->lookups += table->stats.lookups;
+    stats->cellsWritten += table->stats.cellsWritten;
+    stats->cellsMoved += table->stats.cellsMoved;
+    stats->bytes += table->stats.bytes;
+    table->stats = (stats_t){0};
+}
+
+void addStats(stats_t *to, const stats_t *from) {
+    to->nanoseconds += from->nanoseconds;
+    to->rows += from->rows;
+    to->lookups += from->lookups;
+    to->cellsWritten += from->cellsWritten;
+    to->cellsMoved += from->cellsMoved;
+    to->bytes += from->bytes;
+}
+
+// one tab separated line for every command, the first column is "stats" so it can be found in stderr
+void printStatsLine(const char *name, step_t *step, stats_t *stats) {
+    fprintf(stderr, "stats\t%s", name);
+    if (step != NULL) {
+        for (int k=0; k<step->command->numParameters; k++) {
+            if (step->parameters[k] == DASH_NUMBER)
+                fputs(" -", stderr);
+            else
+                fprintf(stderr, " %d", step->parameters[k]);
+        }
+        if (step->strParameter != NULL)
+            fprintf(stderr, " %s", step->strParameter);
+    }
+
+    fprintf(stderr, "\t%.3f\t%llu\t%llu\t%llu\t%llu\t%llu\n", stats->nanoseconds / 1e6,
+        (unsigned long long)stats->rows, (unsigned long long)stats->lookups,
+        (unsigned long long)stats->cellsWritten, (unsigned long long)stats->cellsMoved,
+        (unsigned long long)stats->bytes);
+}
+
+// prints the names of the columns and the stats of reading
+void printReadStats(plan_t *plan) {
+    fputs("stats\tcommand\tms\trows\tlookups\twritten\tmoved\tbytes\n", stderr);
+    printStatsLine("read", NULL, &plan->readStats);
+}
+
+// prints the stats of all commands and printing
+void printStepStats(plan_t *plan) {
+    for (int i=0; i<plan->numSteps; i++)
+        printStatsLine(plan->steps[i].command->name, &plan->steps[i], &plan->steps[i].stats);
+    printStatsLine("print", NULL, &plan->printStats);
+}
+
+// prints the stats of reading, all commands and printing
+void printPlanStats(plan_t *plan) {
+    printReadStats(plan);
+    printStepStats(plan);
+}
+#endif
+
+// makes the view, if the table does not have one yet
+// at first it has all rows and columns of the cells
+state_t makeView(table_t *table) {
+    if (table->view != NULL)
+        return SUCCESS;
+
+    int numRows = countRows(table);
+    int numCols = countColumns(table);
+
+    view_t *view = malloc(sizeof(view_t));
+    if (view == NULL)
+        return ERR_NO_MEMORY;
+
+    view->rows = malloc((numRows > 0 ? numRows : 1) * sizeof(int));
+    view->cols = malloc((numCols > 0 ? numCols : 1) * sizeof(int));
+    if ((view->rows == NULL) || (view->cols == NULL)) {
+        free(view->rows);
+        free(view->cols);
+        free(view);
+        return ERR_NO_MEMORY;
+    }
+
+    for (int i=0; i<numRows; i++)
+        view->rows[i] = i+1;
+    for (int i=0; i<numCols; i++)
+        view->cols[i] = i+1;
+
+    view->rowCapacity = numRows;
+    view->numRows = numRows;
+    view->numCols = numCols;
+    table->view = view;
+    return SUCCESS;
+}
+
+// inserts an empty row into the table
+state_t irow(table_t *table, int row) {
+    if (row < 1 || row > countRows(table)+1) {
+        return ERR_OUT_OF_RANGE;
+    }
+
+    state_t s = makeView(table);
+    if (s != SUCCESS) {
+        return s;
+    }
+
+    view_t *view = table->view;
+    int numRows = countRows(table);
+
+    // grow at least twice, so that appending rows does not reallocate every time
+    if (numRows == view->rowCapacity) {
+        int capacity = (view->rowCapacity > 0) ? 2 * view->rowCapacity : 1;
+        int *rows = realloc(view->rows, capacity * sizeof(int));
+        if (rows == NULL) {
+            return ERR_NO_MEMORY;
+        }
+        view->rows = rows;
+        view->rowCapacity = capacity;
+    }
+
+    memmove(&view->rows[row], &view->rows[row-1], (numRows-row+1) * sizeof(int));
+    view->rows[row-1] = 0;
+    STATS(countMoved(table, numRows-row+1);)
+
+    table->numRows++;
+    return SUCCESS;
+}
+
+// appends an empty row to the table
+state_t arow(table_t *table) {
+    return irow(table, countRows(table)+1);
+}
+
+// deletes rows from m to n from the table
+state_t drows(table_t *table, int m, int n) {
+    if (n < m)
+        return ERR_BAD_SYNTAX;
+
+    int numRows = countRows(table);
+    if ((m < 1) || (m > numRows))
+        return ERR_OUT_OF_RANGE;
+
+    state_t s = makeView(table);
+    if (s != SUCCESS)
+        return s;
+
+    // rows up to the end of the table are deleted, even if n is too big,
+    // so the table is left the same as when the rows were deleted one by one
+    int last = (n > numRows) ? numRows : n;
+
+    int *rows = table->view->rows;
+    memmove(&rows[m-1], &rows[last], (numRows-last) * sizeof(int));
+    STATS(countMoved(table, numRows-last);)
+
+    table->numRows -= last-m+1;
+    return (n > numRows) ? ERR_OUT_OF_RANGE : SUCCESS;
+}
+
+// deletes a row from the table
+state_t drow(table_t *table, int row) {
+    return drows(table, row, row);
+}
+
+// Changes the columns of the table to the ones given by source
+// source[c] is the old column of the new column c+1, or 0 for a new empty column
+// only the view is changed, so it takes the same time for any number of rows
+state_t projectColumns(table_t *table, const int *source, int numCols) {
+    state_t s = makeView(table);
+    if (s != SUCCESS)
+        return s;
+
+    int *cols = malloc((numCols > 0 ? numCols : 1) * sizeof(int));
+    if (cols == NULL)
+        return ERR_NO_MEMORY;
+
+    int *oldCols = table->view->cols;
+    for (int c=0; c<numCols; c++)
+        cols[c] = (source[c] == 0) ? 0 : oldCols[source[c]-1];
+    STATS(countMoved(table, numCols);)
+
+    free(oldCols);
+    table->view->cols = cols;
+    table->numCols = numCols;
+    return SUCCESS;
+}
+
+// inserts an empty column into the table
+state_t icol(table_t *table, int col) {
+    int numCols = countColumns(table);
+    if (col < 1 || col > numCols+1)
+        return ERR_OUT_OF_RANGE;
+
+    int *source = malloc((numCols+1) * sizeof(int));
+    if (source == NULL)
+        return ERR_NO_MEMORY;
+
+    for (int c=1; c<=numCols+1; c++) {
+        if (c < col)
+            source[c-1] = c;
+        else
+            source[c-1] = (c == col) ? 0 : c-1;
+    }
+
+    state_t s = projectColumns(table, source, numCols+1);
+    free(source);
+    return s;
+}
+
+// appends an empty column to the table
+state_t acol(table_t *table) {
+    return icol(table, countColumns(table)+1);
+}
+
+// deletes columns from m to n from the table
+// the errors are the same as if the columns were deleted one by one
 state_t dcols(table_t *table, int m, int n) {
     if (n < m)
         return ERR_BAD_SYNTAX;
 
-    for (int i=m; i<=n; i++) {
-        state_t s = dcol(table, m);
-        if (s != SUCCESS)
-            return s;
+    int numCols = countColumns(table);
+    if (m < 1)
+        return ERR_OUT_OF_RANGE;
+
+    // the last column cannot be deleted
+    if ((m == 1) && (n >= numCols))
+        return ERR_TABLE_EMPTY;
+
+    if (m > numCols)
+        return ERR_OUT_OF_RANGE;
+
+    // the same as with rows in drows()
+    int last = (n > numCols) ? numCols : n;
+
+    int *source = malloc(numCols * sizeof(int));
+    if (source == NULL)
+        return ERR_NO_MEMORY;
+
+    int newCols = 0;
+    for (int c=1; c<=numCols; c++) {
+        if ((c < m) || (c > last))
+            source[newCols++] = c;
+    }
+
+    state_t s = projectColumns(table, source, newCols);
+    free(source);
+    if ((s == SUCCESS) && (n > numCols))
+        return ERR_OUT_OF_RANGE;
+    return s;
+}
+
+// deletes a column from the table
+state_t dcol(table_t *table, int col) {
+    return dcols(table, col, col);
+}
+
+// the columns of the table after the project command, see compileProject()
+typedef struct {
+    int numCols;
+    int columns[]; // column numbers or DASH_NUMBER for a new empty column
+} projection_t;
+
+// reads the list of columns like 3,1,-,2
+state_t compileProject(step_t *step, plan_t *plan) {
+    (void)plan;
+    int numCols = 1;
+    for (size_t i=0; i<step->strLength; i++)
+        numCols += (step->strParameter[i] == ',');
+
+    projection_t *projection = malloc(sizeof(projection_t) + numCols * sizeof(int));
+    if (projection == NULL)
+        return ERR_NO_MEMORY;
+    projection->numCols = numCols;
+
+    char *text = step->strParameter;
+    for (int c=0; c<numCols; c++) {
+        char *end = text;
+        if (*text == '-') {
+            projection->columns[c] = DASH_NUMBER;
+            end++;
+        } else if ((*text >= '0') && (*text <= '9')) {
+            long col = strtol(text, &end, 10);
+            projection->columns[c] = (col > INT_MAX) ? INT_MAX : col;
+        }
+
+        // every column is followed by a comma, except for the last one
+        if ((end == text) || (*end != ((c < numCols-1) ? ',' : '\0'))) {
+            free(projection);
+            return ERR_BAD_SYNTAX;
+        }
+        text = end + 1;
+    }
+
+    step->data = projection;
+    return SUCCESS;
+}
+
+void freeProject(step_t *step) {
+    free(step->data);
+}
+
+// rebuilds the table with the listed columns in one pass
+state_t project(table_t *table, step_t *step) {
+    projection_t *projection = step->data;
+
+    int *source = malloc(projection->numCols * sizeof(int));
+    if (source == NULL)
+        return ERR_NO_MEMORY;
+
+    state_t s = SUCCESS;
+    for (int c=0; c<projection->numCols; c++) {
+        int col = projection->columns[c];
+        if ((col != DASH_NUMBER) && ((col < 1) || (col > countColumns(table))))
+            s = ERR_OUT_OF_RANGE;
+        source[c] = (col == DASH_NUMBER) ? 0 : col;
+    }
+
+    if (s == SUCCESS)
+        s = projectColumns(table, source, projection->numCols);
+    free(source);
+    return s;
+}
+
+// adds the text to the output
+// text right behind the previous piece only makes the piece longer,
+// so cells and delimiters, which were not changed, are written right from the input
+state_t writeOutput(output_t *output, const char *text, size_t length) {
+    if (length == 0)
+        return SUCCESS;
+
+    struct iovec *last = (output->numPieces > 0) ? &output->pieces[output->numPieces-1] : NULL;
+    if (!output->copyAll && (last != NULL) && ((char *)last->iov_base + last->iov_len == text)) {
+        last->iov_len += length;
+        return SUCCESS;
+    }
+
+    // short texts are copied, a piece of their own would cost more
+    bool copy = output->copyAll || (length <= OUTPUT_COPY_LIMIT);
+    if ((output->numPieces == OUTPUT_PIECES) || (copy && (output->used + length > OUTPUT_BUFFER_SIZE))) {
+        state_t state = flushOutput(output);
+        if (state != SUCCESS)
+            return state;
+        last = NULL;
+    }
+
+    if (copy && (length <= OUTPUT_BUFFER_SIZE)) {
+        char *copied = &output->buffer[output->used];
+        memcpy(copied, text, length);
+        output->used += length;
+
+        if ((last != NULL) && ((char *)last->iov_base + last->iov_len == copied)) {
+            last->iov_len += length;
+            return SUCCESS;
+        }
+        text = copied;
+    }
+
+    output->pieces[output->numPieces++] = (struct iovec){.iov_base = (char *)text, .iov_len = length};
+
+    // text too long for the buffer cannot wait, when the input is going to change
+    if (output->copyAll && (text != &output->buffer[output->used - length]))
+        return flushOutput(output);
+
+    return SUCCESS;
+}
+
+// checks, if the character behind the cell's text is in the input
+bool isInInput(table_t *table, cell_t *cell) {
+    uintptr_t begin = (uintptr_t)table->input.buffer;
+    uintptr_t end = begin + table->input.length;
+    uintptr_t next = (uintptr_t)cell->text + cell->length;
+    return (begin != 0) && ((uintptr_t)cell->text >= begin) && (next < end);
+}
+
+// Prints the table into stdout
+// there is no formatting, cells are passed to the output as they are
+state_t printTable(table_t *table, output_t *output) {
+    int numCols = countColumns(table);
+
+    for (int row=1; row<=countRows(table); row++) {
+        for (int col=1; col<=numCols; col++) {
+            cell_t *cell = getCell(table, row, col);
+            state_t state = writeOutput(output, cell->text, cell->length);
+            if (state != SUCCESS)
+                return state;
+
+            // last cell in the row ends with \n
+            char end = (col < numCols) ? table->delimiter : '\n';
+
+            // the same character in the input behind the cell makes the piece longer
+            const char *endText = &end;
+            if (isInInput(table, cell) && (cell->text[cell->length] == end))
+                endText = &cell->text[cell->length];
+
+            state = writeOutput(output, endText, 1);
+            if (state != SUCCESS)
+                return state;
+
+            STATS(table->stats.bytes += cell->length + 1;)
+        }
+    }
+    return SUCCESS;
+}
+
+// tries to read int from current argument
+// if it succeeds returns true and increments argument index
+// if there is -, the function assigns DASH_NUMBER constant
+bool readInt(arguments_t *args, int *n) {
+    if (args->index >= args->argc)
+        return false;
+
+    // special case for -
+    if (strcmp(args->argv[args->index], "-") == 0) {
+        *n = DASH_NUMBER;
+        args->index++;
+        return true;
+    }
+
+    char *pEnd;
+    *n = strtol(args->argv[args->index], &pEnd, 10);
+    if (*pEnd != '\0')
+        return false;
+
+    args->index++;
+    return true;
+}
+
+// number read from a cell by readNumber()
+typedef struct {
+    bool negative;
+    uint64_t integer; // the part in front of the decimal point
+    bool roundUp; // the part behind the decimal point is at least 0.5
+} number_t;
+
+// the same characters as isspace() in the C locale
+bool isSpace(char c) {
+    return (c == ' ') || ((c >= '\t') && (c <= '\r'));
+}
+
+// reads a decimal number like strtod() does, but without locale and exactly
+// the whole text has to be the number, an empty text is 0
+// returns false, if it is not a number or its integer part does not fit into int64_t
+bool readNumber(const char *text, int length, number_t *number) {
+    number->negative = false;
+    number->integer = 0;
+    number->roundUp = false;
+
+    if (length == 0)
+        return true;
+
+    int i = 0;
+    while ((i < length) && isSpace(text[i]))
+        i++;
+
+    if ((i < length) && ((text[i] == '+') || (text[i] == '-'))) {
+        number->negative = (text[i] == '-');
+        i++;
+    }
+
+    // significant digits are the ones behind leading zeros
+    int mantissa = i;
+    int numDigits = 0;
+    long pointPos = 0; // number of significant digits in front of the decimal point
+    bool anyDigit = false;
+    bool point = false;
+
+    for (; i < length; i++) {
+        if ((text[i] == '.') && !point) {
+            point = true;
+            continue;
+        }
+        if ((text[i] < '0') || (text[i] > '9'))
+            break;
+
+        anyDigit = true;
+        if ((numDigits == 0) && (text[i] == '0')) {
+            // zeros right behind the decimal point move it to the left
+            if (point)
+                pointPos--;
+            continue;
+        }
+        numDigits++;
+        if (!point)
+            pointPos++;
+    }
+    int mantissaEnd = i;
+
+    if (!anyDigit)
+        return false;
+
+    if ((i < length) && ((text[i] == 'e') || (text[i] == 'E'))) {
+        i++;
+        bool negativeExp = false;
+        if ((i < length) && ((text[i] == '+') || (text[i] == '-'))) {
+            negativeExp = (text[i] == '-');
+            i++;
+        }
+        if ((i >= length) || (text[i] < '0') || (text[i] > '9'))
+            return false;
+
+        long exponent = 0;
+        for (; (i < length) && (text[i] >= '0') && (text[i] <= '9'); i++) {
+            // bigger exponents have the same result
+            if (exponent < 1000000)
+                exponent = exponent*10 + text[i] - '0';
+        }
+        pointPos += negativeExp ? -exponent : exponent;
+    }
+
+    if (i != length)
+        return false;
+
+    if (numDigits == 0)
+        return true;
+
+    // 10^19 does not fit into int64_t, anything below fits into uint64_t
+    if (pointPos > 19)
+        return false;
+
+    int k = 0; // index of the significant digit
+    for (i = mantissa; (i < mantissaEnd) && (k <= pointPos); i++) {
+        if ((text[i] == '.') || ((k == 0) && (text[i] == '0')))
+            continue;
+
+        if (k < pointPos)
+            number->integer = number->integer*10 + text[i] - '0';
+        else
+            number->roundUp = (text[i] >= '5');
+        k++;
+    }
+    // zeros behind the last significant digit
+    for (; k < pointPos; k++)
+        number->integer *= 10;
+
+    return number->integer <= INT64_MAX;
+}
+
+// powers of ten, which are exact in double
+const double exactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// reads a decimal number like strtod() does, but without locale
+// the whole text has to be the number, only spaces in front of it are allowed, inf, nan or 0x10 are not numbers
+// numbers with up to 15 digits and a small exponent are computed directly and exactly,
+// only the other ones are left for strtod()
+bool readDouble(const char *text, int length, double *value) {
+    int i = 0;
+    while ((i < length) && isSpace(text[i]))
+        i++;
+
+    bool negative = false;
+    if ((i < length) && ((text[i] == '+') || (text[i] == '-'))) {
+        negative = (text[i] == '-');
+        i++;
+    }
+
+    uint64_t mantissa = 0;
+    int numDigits = 0; // significant digits in the mantissa
+    long exponent = 0;
+    bool anyDigit = false;
+    bool point = false;
+
+    for (; i < length; i++) {
+        if ((text[i] == '.') && !point) {
+            point = true;
+            continue;
+        }
+        if ((text[i] < '0') || (text[i] > '9'))
+            break;
+
+        anyDigit = true;
+        if ((numDigits == 0) && (text[i] == '0')) {
+            if (point)
+                exponent--;
+            continue;
+        }
+
+        // digits, which do not fit, only move the decimal point, the number is read by strtod()
+        if (numDigits < 19) {
+            mantissa = mantissa*10 + text[i] - '0';
+            if (point)
+                exponent--;
+        } else if (!point) {
+            exponent++;
+        }
+        numDigits++;
+    }
+
+    if (!anyDigit)
+        return false;
+
+    if ((i < length) && ((text[i] == 'e') || (text[i] == 'E'))) {
+        i++;
+        bool negativeExp = false;
+        if ((i < length) && ((text[i] == '+') || (text[i] == '-'))) {
+            negativeExp = (text[i] == '-');
+            i++;
+        }
+        if ((i >= length) || (text[i] < '0') || (text[i] > '9'))
+            return false;
+
+        long e = 0;
+        for (; (i < length) && (text[i] >= '0') && (text[i] <= '9'); i++) {
+            // bigger exponents have the same result
+            if (e < 1000000)
+                e = e*10 + text[i] - '0';
+        }
+        exponent += negativeExp ? -e : e;
+    }
+
+    if (i != length)
+        return false;
+
+    // both the mantissa and the power are exact, so the result is rounded only once
+    if ((numDigits <= 15) && (exponent >= -22) && (exponent <= 22)) {
+        *value = (exponent >= 0) ? (double)mantissa * exactPowers[exponent]
+            : (double)mantissa / exactPowers[-exponent];
+        if (negative)
+            *value = -*value;
+        return true;
+    }
+
+    if (length > MAX_NUMBER_LENGTH)
+        return false;
+
+    char buffer[MAX_NUMBER_LENGTH+1];
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    *value = strtod(buffer, NULL);
+    return true;
+}
+
+// writes the integer into the cell
+state_t writeInteger(table_t *table, cell_t *cell, bool negative, uint64_t value) {
+    char buffer[24];
+    int i = sizeof(buffer);
+
+    // there is no negative zero
+    if (value == 0)
+        negative = false;
+
+    do {
+        buffer[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    if (negative)
+        buffer[--i] = '-';
+
+    return setCellText(table, cell, &buffer[i], sizeof(buffer) - i);
+}
+
+// if there is a number in the cell, it is rounded half away from zero
+state_t roundCell(table_t *table, cell_t *cell) {
+    number_t number;
+    if (!readNumber(cell->text, cell->length, &number))
+        return SUCCESS;
+
+    // the rounded number has to fit too
+    if (number.roundUp && (number.integer == INT64_MAX))
+        return SUCCESS;
+
+    return writeInteger(table, cell, number.negative, number.integer + number.roundUp);
+}
+
+// if there is a number in the cell, only its integer part is kept
+state_t intCell(table_t *table, cell_t *cell) {
+    number_t number;
+    if (!readNumber(cell->text, cell->length, &number))
+        return SUCCESS;
+
+    return writeInteger(table, cell, number.negative, number.integer);
+}
+
+// flips the case of the letters from first to last, the other characters are left as they are
+void flipCaseScalar(char *text, int length, char first, char last) {
+    for (int i=0; i<length; i++) {
+        if ((text[i]>=first) && (text[i]<=last))
+            text[i] ^= 'a'-'A';
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// 16 characters at a time
+// a character is in the range, if it is below first+26 after shifting first to -128
+void flipCaseSSE2(char *text, int length, char first, char last) {
+    const __m128i shift = _mm_set1_epi8((char)(128 - first));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + (last - first + 1)));
+    const __m128i flip = _mm_set1_epi8('a'-'A');
+
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i *)&text[i]);
+        __m128i inRange = _mm_cmplt_epi8(_mm_add_epi8(chars, shift), limit);
+        chars = _mm_xor_si128(chars, _mm_and_si128(inRange, flip));
+        _mm_storeu_si128((__m128i *)&text[i], chars);
+    }
+    flipCaseScalar(&text[i], length - i, first, last);
+}
+
+// the same with 32 characters at a time
+__attribute__((target("avx2")))
+void flipCaseAVX2(char *text, int length, char first, char last) {
+    const __m256i shift = _mm256_set1_epi8((char)(128 - first));
+    const __m256i limit = _mm256_set1_epi8((char)(-128 + (last - first + 1)));
+    const __m256i flip = _mm256_set1_epi8('a'-'A');
+
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i *)&text[i]);
+        __m256i inRange = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(chars, shift));
+        chars = _mm256_xor_si256(chars, _mm256_and_si256(inRange, flip));
+        _mm256_storeu_si256((__m256i *)&text[i], chars);
+    }
+    flipCaseSSE2(&text[i], length - i, first, last);
+}
+#endif
+
+// the best version for this processor, chosen by initKernels()
+void (*flipCase)(char *, int, char, char) = &flipCaseScalar;
+
+int countBits(uint64_t bits);
+
+// result of the aggregation commands over a part of the column
+typedef struct {
+    double sum;
+    double min;
+    double max;
+    uint64_t count; // numbers in the part, the other values are NaN
+} aggregate_t;
+
+// adds the values, which are not NaN, into the aggregate
+// the sum is made in 4 lanes, value i goes into lane i%4, they are added as (0+1)+(2+3) at the end
+// vector versions do the same, so the result does not depend on the processor
+void aggregateScalar(const double *values, size_t length, aggregate_t *result) {
+    double sums[4] = {0, 0, 0, 0};
+    for (size_t i=0; i<length; i++) {
+        double value = values[i];
+        if (isnan(value))
+            continue;
+
+        sums[i % 4] += value;
+        if (value < result->min)
+            result->min = value;
+        if (value > result->max)
+            result->max = value;
+        result->count++;
+    }
+    result->sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#ifdef HAVE_X86_SIMD
+// 4 values at a time in two vectors, one for lanes 0 and 1, the other for lanes 2 and 3
+// NaN is masked out of the sum, min and max return their second operand for it
+void aggregateSSE2(const double *values, size_t length, aggregate_t *result) {
+    __m128d sums[2] = {_mm_setzero_pd(), _mm_setzero_pd()};
+    __m128d min = _mm_set1_pd(result->min);
+    __m128d max = _mm_set1_pd(result->max);
+    uint64_t count = 0;
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        for (int k=0; k<2; k++) {
+            __m128d value = _mm_loadu_pd(&values[i + 2*k]);
+            __m128d isNumber = _mm_cmpord_pd(value, value);
+            sums[k] = _mm_add_pd(sums[k], _mm_and_pd(isNumber, value));
+            min = _mm_min_pd(value, min);
+            max = _mm_max_pd(value, max);
+            count += countBits(_mm_movemask_pd(isNumber));
+        }
+    }
+
+    double lanes[4], mins[2], maxs[2];
+    _mm_storeu_pd(&lanes[0], sums[0]);
+    _mm_storeu_pd(&lanes[2], sums[1]);
+    _mm_storeu_pd(mins, min);
+    _mm_storeu_pd(maxs, max);
+
+    // the rest goes into the same lanes as in aggregateScalar()
+    for (; i < length; i++) {
+        if (!isnan(values[i])) {
+            lanes[i % 4] += values[i];
+            mins[0] = (values[i] < mins[0]) ? values[i] : mins[0];
+            maxs[0] = (values[i] > maxs[0]) ? values[i] : maxs[0];
+            count++;
+        }
+    }
+
+    result->sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    result->min = (mins[1] < mins[0]) ? mins[1] : mins[0];
+    result->max = (maxs[1] > maxs[0]) ? maxs[1] : maxs[0];
+    result->count += count;
+}
+
+// the same with all 4 lanes in one vector
+__attribute__((target("avx2")))
+void aggregateAVX2(const double *values, size_t length, aggregate_t *result) {
+    __m256d sum = _mm256_setzero_pd();
+    __m256d min = _mm256_set1_pd(result->min);
+    __m256d max = _mm256_set1_pd(result->max);
+    uint64_t count = 0;
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256d value = _mm256_loadu_pd(&values[i]);
+        __m256d isNumber = _mm256_cmp_pd(value, value, _CMP_ORD_Q);
+        sum = _mm256_add_pd(sum, _mm256_and_pd(isNumber, value));
+        min = _mm256_min_pd(value, min);
+        max = _mm256_max_pd(value, max);
+        count += countBits(_mm256_movemask_pd(isNumber));
+    }
+
+    double lanes[4], mins[4], maxs[4];
+    _mm256_storeu_pd(lanes, sum);
+    _mm256_storeu_pd(mins, min);
+    _mm256_storeu_pd(maxs, max);
+
+    for (; i < length; i++) {
+        if (!isnan(values[i])) {
+            lanes[i % 4] += values[i];
+            mins[0] = (values[i] < mins[0]) ? values[i] : mins[0];
+            maxs[0] = (values[i] > maxs[0]) ? values[i] : maxs[0];
+            count++;
+        }
+    }
+
+    result->sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (int k=1; k<4; k++) {
+        mins[0] = (mins[k] < mins[0]) ? mins[k] : mins[0];
+        maxs[0] = (maxs[k] > maxs[0]) ? maxs[k] : maxs[0];
+    }
+    result->min = mins[0];
+    result->max = maxs[0];
+    result->count += count;
+}
+#endif
+
+// the best version for this processor, chosen by initKernels()
+void (*aggregate)(const double *, size_t, aggregate_t *) = &aggregateScalar;
+
+// chooses the versions of functions according to the processor
+void initKernels() {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        flipCase = &flipCaseAVX2;
+        aggregate = &aggregateAVX2;
+    } else {
+        flipCase = &flipCaseSSE2;
+        aggregate = &aggregateSSE2;
+    }
+#endif
+}
+
+// gives the cell text of its own, if it shares the input with other tables
+// so it can be changed in place
+state_t ownCellText(table_t *table, cell_t *cell) {
+    if (!table->sharedInput || (cell->length == 0) || !isInputText(table, cell))
+        return SUCCESS;
+
+    char *text = allocText(table, cell->length);
+    if (text == NULL)
+        return ERR_NO_MEMORY;
+
+    memcpy(text, cell->text, cell->length);
+    cell->text = text;
+    return SUCCESS;
+}
+
+// makes the cell uppercase, the text is changed in place
+state_t upperCell(table_t *table, cell_t *cell) {
+    state_t state = ownCellText(table, cell);
+    if (state != SUCCESS)
+        return state;
+
+    flipCase(cell->text, cell->length, 'a', 'z');
+    STATS(table->stats.cellsWritten++;)
+    STATS(table->stats.bytes += cell->length;)
+    return SUCCESS;
+}
+
+// makes the cell lowercase, the text is changed in place
+state_t lowerCell(table_t *table, cell_t *cell) {
+    state_t state = ownCellText(table, cell);
+    if (state != SUCCESS)
+        return state;
+
+    flipCase(cell->text, cell->length, 'A', 'Z');
+    STATS(table->stats.cellsWritten++;)
+    STATS(table->stats.bytes += cell->length;)
+    return SUCCESS;
+}
+
+// returns number of words of the selection needed for the rows
+size_t selectionWords(int numRows) {
+    return ((size_t)numRows + WORD_BITS-1) / WORD_BITS;
+}
+
+// returns index of the lowest set bit, bits must not be zero
+int countTrailingZeros(uint64_t bits) {
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int n = 0;
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// returns number of set bits
+int countBits(uint64_t bits) {
+#ifdef __GNUC__
+    return __builtin_popcountll(bits);
+#else
+    int n = 0;
+    for (; bits != 0; bits &= bits - 1)
+        n++;
+    return n;
+#endif
+}
+
+// returns the first selected row behind the given one
+// or 0, if there is none, so next selected row from 0 is the first one
+int nextSelectedRow(table_t *table, int row) {
+    // bit of the following row has index row
+    size_t w = (size_t)row / WORD_BITS;
+    size_t numWords = selectionWords(countRows(table));
+
+    if (w >= numWords)
+        return 0;
+
+    // rows in front of the following one are masked out
+    uint64_t bits = table->rowSelected[w] & (~(uint64_t)0 << (row % WORD_BITS));
+
+    // whole words without selected rows are skipped
+    while (bits == 0) {
+        if (++w >= numWords)
+            return 0;
+        bits = table->rowSelected[w];
+    }
+
+    return w*WORD_BITS + countTrailingZeros(bits) + 1;
+}
+
+// returns number of selected rows
+int countSelected(table_t *table) {
+    int n = 0;
+    size_t numWords = selectionWords(countRows(table));
+    for (size_t w=0; w<numWords; w++)
+        n += countBits(table->rowSelected[w]);
+    return n;
+}
+
+// checks, if the column exists
+// data commands check it only when they get to the first selected row
+bool isValidColumn(table_t *table, int col) {
+    return (col >= 1) && (col <= countColumns(table));
+}
+
+// modifies the cell of the row in the step's column with the modFunction
+state_t modifyRow(table_t *table, step_t *step, int row, state_t(*modFunction)(table_t *, cell_t *)) {
+    int col = step->parameters[0];
+    if (!isValidColumn(table, col))
+        return ERR_OUT_OF_RANGE;
+
+    return modFunction(table, getCell(table, row, col));
+}
+
+// all of these functions use modifyRow()
+state_t upperRow(table_t *table, step_t *step, int row) {
+    return modifyRow(table, step, row, &upperCell);
+}
+
+state_t lowerRow(table_t *table, step_t *step, int row) {
+    return modifyRow(table, step, row, &lowerCell);
+}
+
+state_t roundRow(table_t *table, step_t *step, int row) {
+    return modifyRow(table, step, row, &roundCell);
+}
+
+state_t intRow(table_t *table, step_t *step, int row) {
+    return modifyRow(table, step, row, &intCell);
+}
+
+// functions to rewrite data in columns, one row at a time
+state_t setRow(table_t *table, step_t *step, int row) {
+    int col = step->parameters[0];
+    if (!isValidColumn(table, col))
+        return ERR_OUT_OF_RANGE;
+
+    return setCellText(table, getCell(table, row, col), step->strParameter, step->strLength);
+}
+
+state_t copyRow(table_t *table, step_t *step, int row) {
+    int srcCol = step->parameters[0];
+    int destCol = step->parameters[1];
+    if (!isValidColumn(table, srcCol) || !isValidColumn(table, destCol))
+        return ERR_OUT_OF_RANGE;
+
+    cell_t *src = getCell(table, row, srcCol);
+    return setCellText(table, getCell(table, row, destCol), src->text, src->length);
+}
+
+// cells are swapped without copying their text
+state_t swapRow(table_t *table, step_t *step, int row) {
+    int col1 = step->parameters[0];
+    int col2 = step->parameters[1];
+    if (!isValidColumn(table, col1) || !isValidColumn(table, col2))
+        return ERR_OUT_OF_RANGE;
+
+    cell_t *cell1 = getCell(table, row, col1);
+    cell_t *cell2 = getCell(table, row, col2);
+
+    cell_t tmp = *cell1;
+    *cell1 = *cell2;
+    *cell2 = tmp;
+    STATS(table->stats.cellsWritten += 2;)
+    return SUCCESS;
+}
+
+// moves column n in front of column m
+// the cells in between move by one column, each of them only once
+state_t moveRow(table_t *table, step_t *step, int row) {
+    int n = step->parameters[0];
+    int endPos = step->parameters[1];
+    if (n < endPos)
+        endPos--;
+
+    if (n == endPos)
+        return SUCCESS;
+
+    if (!isValidColumn(table, n) || !isValidColumn(table, endPos))
+        return ERR_OUT_OF_RANGE;
+
+    // direction is -1 or +1
+    int direction = 2*(n < endPos) - 1;
+
+    cell_t moved = *getCell(table, row, n);
+
+    for (int pos=n; pos!=endPos; pos+=direction)
+        *getCell(table, row, pos) = *getCell(table, row, pos+direction);
+
+    *getCell(table, row, endPos) = moved;
+    STATS(table->stats.cellsWritten += direction*(endPos - n) + 1;)
+    return SUCCESS;
+}
+
+// checks the range of rows and stores it as two row numbers
+// in streaming mode - is the end of the input and the range is checked at the last row
+state_t checkRows(table_t *table, step_t *step) {
+    int start = step->parameters[0];
+    int end = step->parameters[1];
+    bool known = !table->streaming || table->lastRow;
+    int last = known ? table->firstRow - 1 + countRows(table) : INT_MAX;
+
+    if (end == DASH_NUMBER) {
+        // command like "rows 5 -" selects lines from 5 to the end
+        if (start == DASH_NUMBER) {
+            // special case for "rows - -", which selects only the last line
+            start = last;
+        }
+        end = last;
+    }
+
+    if (start > end)
+        return ERR_BAD_SYNTAX;
+
+    if ((end > last) || (start < 1))
+        return ERR_OUT_OF_RANGE;
+
+    // the parameters stay as they are, streaming mode checks them again for every row
+    step->range[0] = start;
+    step->range[1] = end;
+    return SUCCESS;
+}
+
+// the range is ANDed with the selection a whole word at a time
+uint64_t selectRows(table_t *table, step_t *step, size_t w, uint64_t bits) {
+    // rows already printed in streaming mode are counted too
+    long first = (long)step->range[0] - table->firstRow + 1;
+    long last = (long)step->range[1] - table->firstRow + 1;
+
+    long wordFirst = (long)w*WORD_BITS + 1; // row of the lowest bit
+    long wordLast = wordFirst + WORD_BITS-1;
+
+    if ((last < wordFirst) || (first > wordLast))
+        return 0;
+
+    // bits from lowBit to highBit are in the range
+    int lowBit = (first > wordFirst) ? first - wordFirst : 0;
+    int highBit = (last < wordLast) ? last - wordFirst : WORD_BITS-1;
+
+    uint64_t mask = (~(uint64_t)0 << lowBit) & (~(uint64_t)0 >> (WORD_BITS-1 - highBit));
+    return bits & mask;
+}
+
+// checks the column of selection commands working with cells
+state_t checkColumn(table_t *table, step_t *step) {
+    if (!isValidColumn(table, step->parameters[0]))
+        return ERR_OUT_OF_RANGE;
+    return SUCCESS;
+}
+
+// keeps selected only the rows, whose cell in the column passes the test
+// the test is skipped for rows, which are not selected anyway
+uint64_t selectByCell(table_t *table, step_t *step, size_t w, uint64_t bits, bool (*test)(cell_t *, step_t *)) {
+    int col = step->parameters[0];
+    uint64_t result = 0;
+
+    // go through the set bits only
+    while (bits != 0) {
+        int bit = countTrailingZeros(bits);
+        bits &= bits - 1;
+
+        int row = w*WORD_BITS + bit + 1;
+        if (test(getCell(table, row, col), step))
+            result |= (uint64_t)1 << bit;
+    }
+    return result;
+}
+
+// the text of the cell starts with the string
+bool beginsWith(cell_t *cell, step_t *step) {
+    size_t strLength = step->strLength;
+    return ((size_t)cell->length >= strLength) && (memcmp(cell->text, step->strParameter, strLength) == 0);
+}
+
+// looks for the string in the text, the first character is found with memchr()
+bool findText(const char *text, size_t length, const char *str, size_t strLength) {
+    if (strLength == 0)
+        return true;
+    if (strLength > length)
+        return false;
+
+    // positions, where the string can start
+    size_t positions = length - strLength + 1;
+    const char *end = text + positions;
+
+    while (text < end) {
+        const char *found = memchr(text, str[0], end - text);
+        if (found == NULL)
+            return false;
+        if (memcmp(found, str, strLength) == 0)
+            return true;
+        text = found + 1;
+    }
+    return false;
+}
+
+#ifdef HAVE_X86_SIMD
+// 16 positions at a time are checked for the first and the last character of the string
+// only the positions, where both of them match, are compared whole
+bool findTextSSE2(const char *text, size_t length, const char *str, size_t strLength) {
+    if ((strLength == 0) || (strLength > length))
+        return findText(text, length, str, strLength);
+
+    size_t positions = length - strLength + 1;
+    const __m128i first = _mm_set1_epi8(str[0]);
+    const __m128i last = _mm_set1_epi8(str[strLength-1]);
+
+    size_t i = 0;
+    for (; i + 16 <= positions; i += 16) {
+        __m128i firstChars = _mm_loadu_si128((const __m128i *)&text[i]);
+        __m128i lastChars = _mm_loadu_si128((const __m128i *)&text[i + strLength-1]);
+        uint64_t candidates = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(firstChars, first), _mm_cmpeq_epi8(lastChars, last)));
+
+        while (candidates != 0) {
+            int bit = countTrailingZeros(candidates);
+            candidates &= candidates - 1;
+
+            if (memcmp(&text[i + bit], str, strLength) == 0)
+                return true;
+        }
+    }
+    // positions left at the end
+    return findText(&text[i], length - i, str, strLength);
+}
+#endif
+
+// the string is somewhere in the text of the cell
+bool contains(cell_t *cell, step_t *step) {
+#ifdef HAVE_X86_SIMD
+    return findTextSSE2(cell->text, cell->length, step->strParameter, step->strLength);
+#else
+    return findText(cell->text, cell->length, step->strParameter, step->strLength);
+#endif
+}
+
+uint64_t selectBeginsWith(table_t *table, step_t *step, size_t w, uint64_t bits) {
+    return selectByCell(table, step, w, bits, &beginsWith);
+}
+
+uint64_t selectContains(table_t *table, step_t *step, size_t w, uint64_t bits) {
+    return selectByCell(table, step, w, bits, &contains);
+}
+
+// reads the whole file into memory, the text is ended with '\0'
+// returns the error state, if the file cannot be read
+state_t readFile(const char *name, char **text, size_t *length, state_t error) {
+    FILE *file = fopen(name, "rb");
+    if (file == NULL)
+        return error;
+
+    size_t capacity = READ_BLOCK_SIZE;
+    *text = malloc(capacity + 1);
+    *length = 0;
+    state_t state = SUCCESS;
+
+    while (*text != NULL) {
+        *length += fread(&(*text)[*length], 1, capacity - *length, file);
+        if (*length < capacity)
+            break;
+
+        capacity *= 2;
+        char *bigger = realloc(*text, capacity + 1);
+        if (bigger == NULL)
+            free(*text);
+        *text = bigger;
+    }
+
+    if (*text == NULL)
+        state = ERR_NO_MEMORY;
+    else if (ferror(file))
+        state = error;
+    else
+        (*text)[*length] = '\0';
+
+    fclose(file);
+    return state;
+}
+
+// splits the text into patterns, the text stays where it is
+// returns number of the patterns, patterns must have space for all of them
+int splitPatterns(char *text, size_t length, char separator, bool skipEmpty, cell_t *patterns) {
+    int numPatterns = 0;
+    size_t start = 0;
+
+    for (size_t i=0; i<=length; i++) {
+        if ((i < length) && (text[i] != separator))
+            continue;
+
+        int patternLength = i - start;
+        // files with \r\n line endings
+        if ((separator == '\n') && (patternLength > 0) && (text[i-1] == '\r'))
+            patternLength--;
+
+        if ((patternLength > 0) || !skipEmpty) {
+            patterns[numPatterns].text = &text[start];
+            patterns[numPatterns].length = patternLength;
+            numPatterns++;
+        }
+        start = i + 1;
+    }
+    return numPatterns;
+}
+
+// frees memory of the automaton
+void freeAutomaton(automaton_t *automaton) {
+    free(automaton->next);
+    free(automaton->pattern);
+    free(automaton->outLink);
+    free(automaton->accept);
+    free(automaton);
+}
+
+// builds the trie of the patterns and turns it into a DFA
+// next state is stored for every pair of state and class of byte, so a cell is scanned one step per byte
+state_t buildAutomaton(automaton_t *automaton, cell_t *patterns, int numPatterns) {
+    // bytes, which are not in any pattern, all behave the same and share class 0
+    memset(automaton->byteClass, 0, sizeof(automaton->byteClass));
+    int numClasses = 1;
+    size_t maxStates = 1;
+    for (int p=0; p<numPatterns; p++) {
+        for (int i=0; i<patterns[p].length; i++) {
+            unsigned char c = patterns[p].text[i];
+            if (automaton->byteClass[c] == 0)
+                automaton->byteClass[c] = numClasses++;
+        }
+        maxStates += patterns[p].length;
+    }
+    automaton->numClasses = numClasses;
+
+    if (maxStates > (size_t)(INT_MAX / numClasses))
+        return ERR_NO_MEMORY;
+
+    automaton->next = malloc(maxStates * numClasses * sizeof(int));
+    automaton->pattern = malloc(maxStates * sizeof(int));
+    automaton->outLink = malloc(maxStates * sizeof(int));
+    automaton->accept = malloc(maxStates * sizeof(bool));
+    int *fail = malloc(maxStates * sizeof(int));
+    int *queue = malloc(maxStates * sizeof(int));
+
+    if (!automaton->next || !automaton->pattern || !automaton->outLink
+            || !automaton->accept || !fail || !queue) {
+        free(fail);
+        free(queue);
+        return ERR_NO_MEMORY;
+    }
+
+    // the trie, -1 is a missing edge
+    int numStates = 1;
+    for (int i=0; i<numClasses; i++)
+        automaton->next[i] = -1;
+    automaton->pattern[0] = -1;
+
+    // the same patterns end in the same state, so they are counted only once
+    int numDistinct = 0;
+    for (int p=0; p<numPatterns; p++) {
+        int s = 0;
+        for (int i=0; i<patterns[p].length; i++) {
+            int *edge = &automaton->next[s*numClasses + automaton->byteClass[(unsigned char)patterns[p].text[i]]];
+            if (*edge == -1) {
+                *edge = numStates;
+                for (int k=0; k<numClasses; k++)
+                    automaton->next[numStates*numClasses + k] = -1;
+                automaton->pattern[numStates] = -1;
+                numStates++;
+            }
+            s = *edge;
+        }
+        if (automaton->pattern[s] == -1)
+            automaton->pattern[s] = numDistinct++;
+    }
+    automaton->numStates = numStates;
+    automaton->numPatterns = numDistinct;
+
+    // states are visited by their depth, failure links point to a state closer to the root
+    // missing edges are replaced by the edges of the failure state
+    int head = 0, tail = 0;
+    fail[0] = 0;
+    automaton->outLink[0] = -1;
+    automaton->accept[0] = (automaton->pattern[0] != -1);
+    queue[tail++] = 0;
+
+    while (head < tail) {
+        int s = queue[head++];
+        for (int c=0; c<numClasses; c++) {
+            int *edge = &automaton->next[s*numClasses + c];
+            int failNext = (s == 0) ? 0 : automaton->next[fail[s]*numClasses + c];
+
+            if (*edge == -1) {
+                *edge = failNext;
+                continue;
+            }
+
+            int t = *edge;
+            fail[t] = failNext;
+            automaton->outLink[t] = (automaton->pattern[failNext] != -1) ? failNext : automaton->outLink[failNext];
+            automaton->accept[t] = (automaton->pattern[t] != -1) || automaton->accept[failNext];
+            queue[tail++] = t;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return SUCCESS;
+}
+
+// builds the automaton from the patterns given as "a|b|c" or as @file with one pattern on each line
+// clients of the server cannot use @file, the server would read any file it can read for them
+state_t compilePatterns(step_t *step, plan_t *plan, bool matchAll) {
+    if (plan->serving && (step->strParameter[0] == '@'))
+        return ERR_FILE_REQUEST;
+
+    automaton_t *automaton = calloc(1, sizeof(automaton_t));
+    if (automaton == NULL)
+        return ERR_NO_MEMORY;
+    automaton->matchAll = matchAll;
+
+    char *text = step->strParameter;
+    char *fileText = NULL;
+    size_t length = step->strLength;
+    char separator = '|';
+    state_t state = SUCCESS;
+
+    if (text[0] == '@') {
+        state = readFile(&text[1], &fileText, &length, ERR_PATTERN_FILE);
+        text = fileText;
+        separator = '\n';
+    }
+
+    // there is at most one pattern more than separators
+    cell_t *patterns = NULL;
+    if (state == SUCCESS) {
+        size_t maxPatterns = 1;
+        for (size_t i=0; i<length; i++)
+            maxPatterns += (text[i] == separator);
+
+        patterns = malloc(maxPatterns * sizeof(cell_t));
+        if (patterns == NULL)
+            state = ERR_NO_MEMORY;
+    }
+
+    if (state == SUCCESS) {
+        // empty lines of a file are not patterns, "" given inline is
+        int numPatterns = splitPatterns(text, length, separator, separator == '\n', patterns);
+        state = buildAutomaton(automaton, patterns, numPatterns);
+    }
+
+    free(patterns);
+    free(fileText);
+    if (state != SUCCESS) {
+        freeAutomaton(automaton);
+        return state;
+    }
+
+    step->data = automaton;
+    return SUCCESS;
+}
+
+state_t compileAnyPatterns(step_t *step, plan_t *plan) {
+    return compilePatterns(step, plan, false);
+}
+
+state_t compileAllPatterns(step_t *step, plan_t *plan) {
+    return compilePatterns(step, plan, true);
+}
+
+void freePatterns(step_t *step) {
+    freeAutomaton(step->data);
+}
+
+// runs the automaton over the text of the cell
+// in any-match mode it stops at the first pattern found,
+// in all-match mode when all patterns were found
+bool containsPatterns(cell_t *cell, step_t *step) {
+    automaton_t *automaton = step->data;
+    const int *next = automaton->next;
+    int numClasses = automaton->numClasses;
+
+    if (!automaton->matchAll) {
+        int s = 0;
+        if (automaton->accept[0])
+            return true;
+
+        for (int i=0; i<cell->length; i++) {
+            s = next[s*numClasses + automaton->byteClass[(unsigned char)cell->text[i]]];
+            if (automaton->accept[s])
+                return true;
+        }
+        return false;
+    }
+
+    // patterns found in this cell, the automaton is shared by the threads
+    size_t numWords = selectionWords(automaton->numPatterns);
+    uint64_t found[numWords > 0 ? numWords : 1];
+    memset(found, 0, sizeof(found));
+    int numFound = 0;
+
+    int s = 0;
+    for (int i=-1; (i<cell->length) && (numFound < automaton->numPatterns); i++) {
+        // the empty pattern is found before the first byte
+        if (i >= 0)
+            s = next[s*numClasses + automaton->byteClass[(unsigned char)cell->text[i]]];
+
+        int t = (automaton->pattern[s] != -1) ? s : automaton->outLink[s];
+        for (; t != -1; t = automaton->outLink[t]) {
+            int p = automaton->pattern[t];
+            uint64_t bit = (uint64_t)1 << (p % WORD_BITS);
+            if ((found[p / WORD_BITS] & bit) == 0) {
+                found[p / WORD_BITS] |= bit;
+                numFound++;
+            }
+        }
+    }
+    return numFound == automaton->numPatterns;
+}
+
+uint64_t selectPatterns(table_t *table, step_t *step, size_t w, uint64_t bits) {
+    return selectByCell(table, step, w, bits, &containsPatterns);
+}
+
+// adds a node to the NFA, the nodes are made bigger only by repeated parts, see compileRegex()
+// when there is no space, the parser stops and the node 0 is returned, the NFA is thrown away then
+int addNode(regex_parser_t *parser, node_type_t type) {
+    dfa_t *dfa = parser->dfa;
+    if (dfa->numNodes == dfa->nodeCapacity) {
+        int capacity = (dfa->nodeCapacity < dfa->maxNodes / 2) ? 2 * dfa->nodeCapacity : dfa->maxNodes;
+        nfa_node_t *nodes = NULL;
+        if (capacity > dfa->numNodes)
+            nodes = realloc(dfa->nodes, capacity * sizeof(nfa_node_t));
+
+        if (nodes == NULL) {
+            if (parser->state == SUCCESS)
+                parser->state = (capacity > dfa->numNodes) ? ERR_NO_MEMORY : ERR_BAD_REGEX;
+            return 0;
+        }
+        dfa->nodes = nodes;
+        dfa->nodeCapacity = capacity;
+    }
+
+    int n = dfa->numNodes++;
+    nfa_node_t *node = &dfa->nodes[n];
+    node->type = type;
+    node->out = -1;
+    node->out2 = -1;
+    memset(node->chars, 0, sizeof(node->chars));
+    return n;
+}
+
+// fragment with a node reading one of the bytes
+fragment_t charFragment(regex_parser_t *parser, node_type_t type) {
+    fragment_t fragment;
+    fragment.start = addNode(parser, type);
+    fragment.end = addNode(parser, NODE_EMPTY);
+    parser->dfa->nodes[fragment.start].out = fragment.end;
+    return fragment;
+}
+
+void addChar(nfa_node_t *node, unsigned char c) {
+    node->chars[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+bool hasChar(const nfa_node_t *node, unsigned char c) {
+    return (node->chars[c / 64] >> (c % 64)) & 1;
+}
+
+// reads [abc], [^a-z] and similar, the opening bracket is already read
+fragment_t parseClass(regex_parser_t *parser) {
+    fragment_t fragment = charFragment(parser, NODE_CHAR);
+    nfa_node_t *node = &parser->dfa->nodes[fragment.start];
+    const char *text = parser->text;
+
+    bool negate = (parser->pos < parser->length) && (text[parser->pos] == '^');
+    if (negate)
+        parser->pos++;
+
+    // ] right at the start is part of the class
+    bool first = true;
+    while ((parser->pos < parser->length) && ((text[parser->pos] != ']') || first)) {
+        first = false;
+        unsigned char low = text[parser->pos++];
+        if ((low == '\\') && (parser->pos < parser->length))
+            low = text[parser->pos++];
+
+        unsigned char high = low;
+        if ((parser->pos + 1 < parser->length) && (text[parser->pos] == '-') && (text[parser->pos+1] != ']')) {
+            high = text[parser->pos+1];
+            parser->pos += 2;
+            if (high < low)
+                parser->state = ERR_BAD_REGEX;
+        }
+        for (int c=low; c<=high; c++)
+            addChar(node, c);
+    }
+
+    if (parser->pos >= parser->length)
+        parser->state = ERR_BAD_REGEX;
+    parser->pos++;
+
+    if (negate) {
+        for (int i=0; i<4; i++)
+            node->chars[i] = ~node->chars[i];
+    }
+    return fragment;
+}
+
+fragment_t parseAlternation(regex_parser_t *parser);
+
+// reads one character, class or group
+fragment_t parseAtom(regex_parser_t *parser) {
+    char c = parser->text[parser->pos++];
+    fragment_t fragment;
+
+    switch (c) {
+        case '(':
+            // deep nesting would overflow the stack
+            if (++parser->depth > MAX_REGEX_DEPTH) {
+                parser->state = ERR_BAD_REGEX;
+                return charFragment(parser, NODE_EMPTY);
+            }
+            fragment = parseAlternation(parser);
+            parser->depth--;
+            if ((parser->pos >= parser->length) || (parser->text[parser->pos] != ')'))
+                parser->state = ERR_BAD_REGEX;
+            parser->pos++;
+            return fragment;
+
+        case '[':
+            return parseClass(parser);
+
+        case '.':
+            fragment = charFragment(parser, NODE_CHAR);
+            memset(parser->dfa->nodes[fragment.start].chars, 0xff, sizeof(parser->dfa->nodes[0].chars));
+            return fragment;
+
+        case '^':
+            return charFragment(parser, NODE_BEGIN);
+
+        case '$':
+            return charFragment(parser, NODE_END);
+
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            // nothing to repeat
+            parser->state = ERR_BAD_REGEX;
+            return charFragment(parser, NODE_EMPTY);
+
+        case '\\':
+            if (parser->pos >= parser->length) {
+                parser->state = ERR_BAD_REGEX;
+                return charFragment(parser, NODE_EMPTY);
+            }
+            c = parser->text[parser->pos++];
+            break;
+    }
+
+    fragment = charFragment(parser, NODE_CHAR);
+    addChar(&parser->dfa->nodes[fragment.start], c);
+    return fragment;
+}
+
+// reads a number of {m,n}, returns -1 if there is none, or MAX_REGEX_REPEAT+1 if it is too big
+int readRepeatCount(regex_parser_t *parser) {
+    const char *text = parser->text;
+    if ((parser->pos >= parser->length) || (text[parser->pos] < '0') || (text[parser->pos] > '9'))
+        return -1;
+
+    int count = 0;
+    for (; (parser->pos < parser->length) && (text[parser->pos] >= '0') && (text[parser->pos] <= '9'); parser->pos++) {
+        if (count <= MAX_REGEX_REPEAT)
+            count = 10*count + text[parser->pos] - '0';
+    }
+    return (count > MAX_REGEX_REPEAT) ? MAX_REGEX_REPEAT + 1 : count;
+}
+
+// reads m}, m,} or m,n} of {m,n}, max is -1 for m,}
+bool readBound(regex_parser_t *parser, int *min, int *max) {
+    *min = readRepeatCount(parser);
+    *max = *min;
+    if ((parser->pos < parser->length) && (parser->text[parser->pos] == ',')) {
+        parser->pos++;
+        *max = readRepeatCount(parser);
+    }
+
+    if ((parser->pos >= parser->length) || (parser->text[parser->pos] != '}'))
+        return false;
+    parser->pos++;
+
+    // m cannot be left out, n can
+    return (*min >= 0) && (*min <= MAX_REGEX_REPEAT) && (*max <= MAX_REGEX_REPEAT)
+        && ((*max == -1) || (*min <= *max));
+}
+
+fragment_t parseRepeat(regex_parser_t *parser);
+
+// reads {m}, {m,} or {m,n} behind the part of the expression from begin, which is already in the fragment
+// the part is read again for every other copy of it, the copies behind the first m ones are optional
+fragment_t parseBound(regex_parser_t *parser, size_t begin, fragment_t fragment) {
+    size_t end = parser->pos++;
+    int min, max;
+    if (!readBound(parser, &min, &max)) {
+        parser->state = ERR_BAD_REGEX;
+        return fragment;
+    }
+
+    size_t after = parser->pos;
+    size_t length = parser->length;
+    fragment_t result;
+    result.start = result.end = addNode(parser, NODE_EMPTY);
+
+    // {m,} is m copies and one more with *
+    int numCopies = (max == -1) ? min + 1 : max;
+    for (int i=0; (i<numCopies) && (parser->state == SUCCESS); i++) {
+        fragment_t copy = fragment;
+        if (i > 0) {
+            parser->pos = begin;
+            parser->length = end;
+            copy = parseRepeat(parser);
+            parser->length = length;
+        }
+
+        if (i >= min) {
+            int split = addNode(parser, NODE_SPLIT);
+            int next = addNode(parser, NODE_EMPTY);
+            nfa_node_t *nodes = parser->dfa->nodes;
+            nodes[split].out = copy.start;
+            nodes[split].out2 = next;
+            nodes[copy.end].out = (max == -1) ? split : next;
+            copy.start = split;
+            copy.end = next;
+        }
+
+        parser->dfa->nodes[result.end].out = copy.start;
+        result.end = copy.end;
+    }
+
+    parser->pos = after;
+    return result;
+}
+
+// reads an atom with any number of *, +, ? and {m,n}
+fragment_t parseRepeat(regex_parser_t *parser) {
+    size_t begin = parser->pos;
+    fragment_t fragment = parseAtom(parser);
+
+    while ((parser->pos < parser->length) && (parser->state == SUCCESS)) {
+        char c = parser->text[parser->pos];
+        if (c == '{') {
+            fragment = parseBound(parser, begin, fragment);
+            continue;
+        }
+        if ((c != '*') && (c != '+') && (c != '?'))
+            break;
+        parser->pos++;
+
+        int split = addNode(parser, NODE_SPLIT);
+        int end = addNode(parser, NODE_EMPTY);
+        nfa_node_t *nodes = parser->dfa->nodes;
+        nodes[split].out = fragment.start;
+        nodes[split].out2 = end;
+
+        // * and + go back to the split, ? continues to the end
+        nodes[fragment.end].out = (c == '?') ? end : split;
+        if (c != '+')
+            fragment.start = split;
+        fragment.end = end;
+    }
+    return fragment;
+}
+
+// reads atoms following each other up to | or )
+fragment_t parseConcat(regex_parser_t *parser) {
+    fragment_t fragment;
+    fragment.start = fragment.end = addNode(parser, NODE_EMPTY);
+
+    while ((parser->pos < parser->length) && (parser->state == SUCCESS)) {
+        char c = parser->text[parser->pos];
+        if ((c == '|') || (c == ')'))
+            break;
+
+        fragment_t next = parseRepeat(parser);
+        parser->dfa->nodes[fragment.end].out = next.start;
+        fragment.end = next.end;
+    }
+    return fragment;
+}
+
+// reads alternatives separated by |
+fragment_t parseAlternation(regex_parser_t *parser) {
+    fragment_t fragment = parseConcat(parser);
+
+    while ((parser->pos < parser->length) && (parser->text[parser->pos] == '|') && (parser->state == SUCCESS)) {
+        parser->pos++;
+        fragment_t other = parseConcat(parser);
+
+        int split = addNode(parser, NODE_SPLIT);
+        int end = addNode(parser, NODE_EMPTY);
+        nfa_node_t *nodes = parser->dfa->nodes;
+        nodes[split].out = fragment.start;
+        nodes[split].out2 = other.start;
+        nodes[fragment.end].out = end;
+        nodes[other.end].out = end;
+
+        fragment.start = split;
+        fragment.end = end;
+    }
+    return fragment;
+}
+
+// marks the node and all nodes reachable from it without reading a byte
+// ^ can be passed only at the start of the cell, $ only at its end
+void markClosure(dfa_t *dfa, int node, bool atBegin, bool atEnd, char *marks, int *stack) {
+    int size = 0;
+    if (!marks[node]) {
+        marks[node] = 1;
+        stack[size++] = node;
+    }
+
+    while (size > 0) {
+        nfa_node_t *n = &dfa->nodes[stack[--size]];
+        int next[2] = {-1, -1};
+
+        switch (n->type) {
+            case NODE_EMPTY:
+                next[0] = n->out;
+                break;
+            case NODE_SPLIT:
+                next[0] = n->out;
+                next[1] = n->out2;
+                break;
+            case NODE_BEGIN:
+                if (atBegin)
+                    next[0] = n->out;
+                break;
+            case NODE_END:
+                if (atEnd)
+                    next[0] = n->out;
+                break;
+            default:
+                break;
+        }
+
+        for (int i=0; i<2; i++) {
+            if ((next[i] != -1) && !marks[next[i]]) {
+                marks[next[i]] = 1;
+                stack[size++] = next[i];
+            }
+        }
+    }
+}
+
+// only nodes, which read a byte, end the match, or wait for the end, tell the states apart
+bool isSetNode(nfa_node_t *node) {
+    return (node->type == NODE_CHAR) || (node->type == NODE_MATCH) || (node->type == NODE_END);
+}
+
+// marks the nodes reached from the set by reading the byte
+void markStep(dfa_t *dfa, const int *set, int setSize, unsigned char c, char *marks, int *stack) {
+    memset(marks, 0, dfa->numNodes);
+    for (int i=0; i<setSize; i++) {
+        nfa_node_t *node = &dfa->nodes[set[i]];
+        if ((node->type == NODE_CHAR) && hasChar(node, c))
+            markClosure(dfa, node->out, false, false, marks, stack);
+    }
+}
+
+// the set matches, if the cell ends here
+bool acceptsAtEnd(dfa_t *dfa, const int *set, int setSize, char *marks, int *stack) {
+    memset(marks, 0, dfa->numNodes);
+    for (int i=0; i<setSize; i++)
+        markClosure(dfa, set[i], false, true, marks, stack);
+    return marks[dfa->matchNode];
+}
+
+// collects the marked nodes into the set, returns its size
+int collectSet(dfa_t *dfa, const char *marks, int *set) {
+    int size = 0;
+    for (int i=0; i<dfa->numNodes; i++) {
+        if (marks[i] && isSetNode(&dfa->nodes[i]))
+            set[size++] = i;
+    }
+    return size;
+}
+
+// returns the DFA state with the set of marked nodes, it is created if needed
+// returns -1, if there is no space for more states
+int findDfaState(dfa_t *dfa, const char *marks) {
+    int *set = dfa->scratchSet;
+    int setSize = collectSet(dfa, marks, set);
+
+    uint64_t hash = 14695981039346656037u;
+    for (int i=0; i<setSize; i++)
+        hash = (hash ^ set[i]) * 1099511628211u;
+
+    size_t slot = hash % DFA_HASH_SIZE;
+    for (; dfa->hash[slot] != -1; slot = (slot + 1) % DFA_HASH_SIZE) {
+        dfa_state_t *state = &dfa->states[dfa->hash[slot]];
+        if ((state->setSize == setSize) && (memcmp(state->set, set, setSize * sizeof(int)) == 0))
+            return dfa->hash[slot];
+    }
+
+    if (dfa->numStates == MAX_DFA_STATES)
+        return -1;
+
+    dfa_state_t *state = &dfa->states[dfa->numStates];
+    state->set = malloc((setSize > 0 ? setSize : 1) * sizeof(int));
+    state->next = malloc(dfa->numClasses * sizeof(int));
+    if ((state->set == NULL) || (state->next == NULL)) {
+        free(state->set);
+        free(state->next);
+        return -1;
+    }
+
+    memcpy(state->set, set, setSize * sizeof(int));
+    state->setSize = setSize;
+    for (int k=0; k<dfa->numClasses; k++)
+        state->next[k] = -1;
+
+    state->accept = marks[dfa->matchNode];
+    state->acceptAtEnd = acceptsAtEnd(dfa, set, setSize, dfa->scratchMarks, dfa->scratchStack);
+
+    dfa->hash[slot] = dfa->numStates;
+    return dfa->numStates++;
+}
+
+// finds the transition, which was not needed before
+// threads share the DFA, so new states are made one at a time
+// and a transition is published only after its state is complete
+int addTransition(dfa_t *dfa, int from, int byteClass) {
+    pthread_mutex_lock(&dfa->lock);
+
+    int to = dfa->states[from].next[byteClass];
+    if (to == -1) {
+        dfa_state_t *state = &dfa->states[from];
+        markStep(dfa, state->set, state->setSize, dfa->classByte[byteClass], dfa->marks, dfa->scratchStack);
+
+        to = findDfaState(dfa, dfa->marks);
+        if (to != -1)
+            STORE_RELEASE(&state->next[byteClass], to);
+    }
+
+    pthread_mutex_unlock(&dfa->lock);
+    return to;
+}
+
+// simulates the NFA with sets of nodes from the state over the rest of the cell
+// every array has space for all nodes
+bool simulateNfa(dfa_t *dfa, int from, cell_t *cell, int pos, int *set, char *marks, int *stack) {
+    int setSize = dfa->states[from].setSize;
+    memcpy(set, dfa->states[from].set, setSize * sizeof(int));
+
+    for (; pos < cell->length; pos++) {
+        markStep(dfa, set, setSize, cell->text[pos], marks, stack);
+        if (marks[dfa->matchNode])
+            return true;
+        setSize = collectSet(dfa, marks, set);
+    }
+    return acceptsAtEnd(dfa, set, setSize, marks, stack);
+}
+
+// goes on without the DFA, when there is no space for more states
+// long patterns have many nodes, so the arrays are not on the stack, threads of -j and --serve have small ones
+bool matchesSlowly(dfa_t *dfa, int from, cell_t *cell, int pos) {
+    int *set = malloc(2 * dfa->numNodes * sizeof(int));
+    char *marks = malloc(dfa->numNodes);
+
+    bool matches;
+    if ((set != NULL) && (marks != NULL)) {
+        matches = simulateNfa(dfa, from, cell, pos, set, marks, &set[dfa->numNodes]);
+    } else {
+        // without memory the arrays of the DFA are used, one thread at a time
+        pthread_mutex_lock(&dfa->lock);
+        matches = simulateNfa(dfa, from, cell, pos, dfa->scratchSet, dfa->marks, dfa->scratchStack);
+        pthread_mutex_unlock(&dfa->lock);
+    }
+
+    free(set);
+    free(marks);
+    return matches;
+}
+
+// frees memory of the DFA
+void freeDfa(dfa_t *dfa) {
+    for (int i=0; i<dfa->numStates; i++) {
+        free(dfa->states[i].set);
+        free(dfa->states[i].next);
+    }
+    free(dfa->states);
+    free(dfa->hash);
+    free(dfa->nodes);
+    free(dfa->marks);
+    free(dfa->scratchMarks);
+    free(dfa->scratchSet);
+    free(dfa->scratchStack);
+    pthread_mutex_destroy(&dfa->lock);
+    free(dfa);
+}
+
+// splits bytes into classes, bytes of one class are read by the same nodes
+void buildByteClasses(dfa_t *dfa) {
+    memset(dfa->byteClass, 0, sizeof(dfa->byteClass));
+    int numClasses = 1;
+
+    for (int n=0; n<dfa->numNodes; n++) {
+        nfa_node_t *node = &dfa->nodes[n];
+        if (node->type != NODE_CHAR)
+            continue;
+
+        // every class is split into bytes inside and outside of the node's set
+        int split[2*256];
+        for (int i=0; i<2*numClasses; i++)
+            split[i] = -1;
+
+        int newClasses = 0;
+        for (int c=0; c<256; c++) {
+            int key = 2*dfa->byteClass[c] + hasChar(node, c);
+            if (split[key] == -1)
+                split[key] = newClasses++;
+            dfa->byteClass[c] = split[key];
+        }
+        numClasses = newClasses;
+    }
+
+    dfa->numClasses = numClasses;
+    for (int c=255; c>=0; c--)
+        dfa->classByte[dfa->byteClass[c]] = c;
+}
+
+// compiles the regular expression into an NFA, the DFA is built from it while matching
+// supported are characters, ., [classes], groups, |, *, +, ?, {m}, {m,}, {m,n}, ^, $ and \ escapes
+// { has to start a valid bound, otherwise the expression is bad, \{ is the character
+state_t compileRegex(step_t *step, plan_t *plan) {
+    (void)plan;
+    dfa_t *dfa = calloc(1, sizeof(dfa_t));
+    if (dfa == NULL)
+        return ERR_NO_MEMORY;
+
+    // every character of the pattern adds at most 3 nodes, the rest is for the .* in front and the end
+    // only parts repeated by {m,n} add more
+    size_t numNodes = 3*step->strLength + 16;
+    if (numNodes > INT_MAX / 2 - MAX_REPEAT_NODES) {
+        free(dfa);
+        return ERR_NO_MEMORY;
+    }
+    dfa->nodeCapacity = numNodes;
+    dfa->maxNodes = numNodes + MAX_REPEAT_NODES;
+
+    dfa->nodes = malloc(numNodes * sizeof(nfa_node_t));
+    dfa->states = malloc(MAX_DFA_STATES * sizeof(dfa_state_t));
+    dfa->hash = malloc(DFA_HASH_SIZE * sizeof(int));
+    pthread_mutex_init(&dfa->lock, NULL);
+
+    if (!dfa->nodes || !dfa->states || !dfa->hash) {
+        freeDfa(dfa);
+        return ERR_NO_MEMORY;
+    }
+
+    regex_parser_t parser = {.text=step->strParameter, .length=step->strLength, .pos=0,
+        .dfa=dfa, .state=SUCCESS};
+
+    // the pattern can start anywhere in the cell, so it is .*(pattern)
+    int loop = addNode(&parser, NODE_SPLIT);
+    int any = addNode(&parser, NODE_CHAR);
+    memset(dfa->nodes[any].chars, 0xff, sizeof(dfa->nodes[any].chars));
+    dfa->nodes[any].out = loop;
+
+    fragment_t fragment = parseAlternation(&parser);
+    // ) without (
+    if (parser.pos < parser.length)
+        parser.state = ERR_BAD_REGEX;
+
+    dfa->matchNode = addNode(&parser, NODE_MATCH);
+    dfa->nodes[fragment.end].out = dfa->matchNode;
+    dfa->nodes[loop].out = any;
+    dfa->nodes[loop].out2 = fragment.start;
+
+    if (parser.state != SUCCESS) {
+        freeDfa(dfa);
+        return parser.state;
+    }
+
+    // memory used while adding states, the number of nodes is known now
+    dfa->marks = malloc(dfa->numNodes);
+    dfa->scratchMarks = malloc(dfa->numNodes);
+    dfa->scratchSet = malloc(dfa->numNodes * sizeof(int));
+    dfa->scratchStack = malloc(dfa->numNodes * sizeof(int));
+    if (!dfa->marks || !dfa->scratchMarks || !dfa->scratchSet || !dfa->scratchStack) {
+        freeDfa(dfa);
+        return ERR_NO_MEMORY;
+    }
+
+    buildByteClasses(dfa);
+    for (int i=0; i<DFA_HASH_SIZE; i++)
+        dfa->hash[i] = -1;
+
+    memset(dfa->marks, 0, dfa->numNodes);
+    markClosure(dfa, loop, true, false, dfa->marks, dfa->scratchStack);
+    dfa->start = findDfaState(dfa, dfa->marks);
+    if (dfa->start == -1) {
+        freeDfa(dfa);
+        return ERR_NO_MEMORY;
+    }
+
+    step->data = dfa;
+    return SUCCESS;
+}
+
+void freeRegex(step_t *step) {
+    freeDfa(step->data);
+}
+
+// runs the DFA over the text of the cell, missing states are added on the way
+bool matchesRegex(cell_t *cell, step_t *step) {
+    dfa_t *dfa = step->data;
+    int s = dfa->start;
+
+    for (int i=0; i<cell->length; i++) {
+        dfa_state_t *state = &dfa->states[s];
+        if (state->accept)
+            return true;
+
+        int byteClass = dfa->byteClass[(unsigned char)cell->text[i]];
+        int next = LOAD_ACQUIRE(&state->next[byteClass]);
+        if (next == -1) {
+            next = addTransition(dfa, s, byteClass);
+            if (next == -1)
+                return matchesSlowly(dfa, s, cell, i);
+        }
+        s = next;
+    }
+    return dfa->states[s].acceptAtEnd;
+}
+
+uint64_t selectMatches(table_t *table, step_t *step, size_t w, uint64_t bits) {
+    return selectByCell(table, step, w, bits, &matchesRegex);
+}
+
+// order of the sort command, read from its optional words
+typedef struct {
+    bool descending;
+    bool numeric;
+} sort_order_t;
+
+// key of one row for the sort command, it is read from the cell only once
+typedef struct {
+    const char *text;
+    int length;
+    int row;
+    bool isNumber;
+    double number;
+    uint64_t prefix; // first 8 bytes of the text, most keys differ in them
+} sort_key_t;
+
+// part of the keys sorted or merged by one thread, see sortKeys()
+typedef struct {
+    table_t table; // copy of the table, its counters are added to the table after the threads
+    const sort_order_t *order;
+    int col;
+    const int *rows; // rows of the keys, they are read by the thread too
+    sort_key_t *keys;
+    sort_key_t *buffer;
+    size_t begin;
+    size_t middle; // end of the first of the two merged parts
+    size_t end;
+} sort_task_t;
+
+// reads [asc|desc] [num|str] behind the column of the sort command
+state_t readSortOrder(arguments_t *args, step_t *step) {
+    sort_order_t *order = malloc(sizeof(sort_order_t));
+    if (order == NULL)
+        return ERR_NO_MEMORY;
+    order->descending = false;
+    order->numeric = false;
+    step->data = order;
+
+    if ((args->index < args->argc) && ((strcmp(args->argv[args->index], "asc") == 0)
+            || (strcmp(args->argv[args->index], "desc") == 0))) {
+        order->descending = (strcmp(args->argv[args->index], "desc") == 0);
+        args->index++;
+    }
+
+    if ((args->index < args->argc) && ((strcmp(args->argv[args->index], "num") == 0)
+            || (strcmp(args->argv[args->index], "str") == 0))) {
+        order->numeric = (strcmp(args->argv[args->index], "num") == 0);
+        args->index++;
+    }
+    return SUCCESS;
+}
+
+// frees the order of the sort command
+void freeSortOrder(step_t *step) {
+    free(step->data);
+}
+
+// reads the key of the row from its cell in the column
+void readSortKey(table_t *table, const sort_order_t *order, int col, int row, sort_key_t *key) {
+    cell_t *cell = getCell(table, row, col);
+    key->text = cell->text;
+    key->length = cell->length;
+    key->row = row;
+    key->isNumber = order->numeric && readDouble(cell->text, cell->length, &key->number);
+
+    if (!key->isNumber) {
+        key->prefix = 0;
+        for (int i=0; (i<8) && (i<cell->length); i++)
+            key->prefix |= (uint64_t)(unsigned char)cell->text[i] << (56 - 8*i);
+    }
+}
+
+// compares two keys like memcmp()
+// with num the numbers go behind the other cells, which are compared as text, in both orders
+int compareKeys(const sort_key_t *a, const sort_key_t *b, const sort_order_t *order) {
+    int result;
+
+    if (a->isNumber != b->isNumber)
+        return a->isNumber ? 1 : -1;
+
+    if (a->isNumber) {
+        result = (a->number > b->number) - (a->number < b->number);
+    } else if (a->prefix != b->prefix) {
+        result = (a->prefix > b->prefix) ? 1 : -1;
+    } else {
+        int length = (a->length < b->length) ? a->length : b->length;
+        result = memcmp(a->text, b->text, length);
+        if (result == 0)
+            result = (a->length > b->length) - (a->length < b->length);
+    }
+
+    return order->descending ? -result : result;
+}
+
+// merges two sorted parts, keys of the first part go first, when they are equal
+void mergeKeys(const sort_key_t *first, size_t firstLength, const sort_key_t *second, size_t secondLength,
+        sort_key_t *to, const sort_order_t *order) {
+    size_t i = 0, j = 0;
+    while ((i < firstLength) && (j < secondLength)) {
+        if (compareKeys(&second[j], &first[i], order) < 0)
+            *to++ = second[j++];
+        else
+            *to++ = first[i++];
+    }
+    memcpy(to, &first[i], (firstLength - i) * sizeof(sort_key_t));
+    to += firstLength - i;
+    memcpy(to, &second[j], (secondLength - j) * sizeof(sort_key_t));
+}
+
+// stable merge sort of the keys, buffer has to be of the same length
+// short runs are sorted by insertion first, then they are merged into longer ones
+void mergeSort(sort_key_t *keys, sort_key_t *buffer, size_t length, const sort_order_t *order) {
+    const size_t shortRun = 16;
+
+    for (size_t begin=0; begin<length; begin+=shortRun) {
+        size_t end = (begin + shortRun < length) ? begin + shortRun : length;
+        for (size_t i=begin+1; i<end; i++) {
+            sort_key_t key = keys[i];
+            size_t j = i;
+            while ((j > begin) && (compareKeys(&key, &keys[j-1], order) < 0)) {
+                keys[j] = keys[j-1];
+                j--;
+            }
+            keys[j] = key;
+        }
+    }
+
+    sort_key_t *from = keys;
+    sort_key_t *to = buffer;
+    for (size_t run=shortRun; run<length; run*=2) {
+        for (size_t begin=0; begin<length; begin+=2*run) {
+            size_t middle = (begin + run < length) ? begin + run : length;
+            size_t end = (begin + 2*run < length) ? begin + 2*run : length;
+            mergeKeys(&from[begin], middle-begin, &from[middle], end-middle, &to[begin], order);
+        }
+        sort_key_t *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != keys)
+        memcpy(keys, from, length * sizeof(sort_key_t));
+}
+
+// function run by the threads, reads and sorts keys of one part
+void *sortPart(void *arg) {
+    sort_task_t *task = arg;
+    for (size_t i=task->begin; i<task->end; i++)
+        readSortKey(&task->table, task->order, task->col, task->rows[i], &task->keys[i]);
+
+    mergeSort(&task->keys[task->begin], &task->buffer[task->begin], task->end - task->begin, task->order);
+    return NULL;
+}
+
+// function run by the threads, merges two neighbouring parts from keys into buffer
+void *mergePart(void *arg) {
+    sort_task_t *task = arg;
+    mergeKeys(&task->keys[task->begin], task->middle - task->begin, &task->keys[task->middle],
+        task->end - task->middle, &task->buffer[task->begin], task->order);
+    return NULL;
+}
+
+// runs the tasks of given size on threads, the first one and the ones without a thread are done by this thread
+void runTasks(void *(*function)(void *), void *tasks, size_t taskSize, int numTasks) {
+    pthread_t threads[numTasks];
+    bool started[numTasks];
+
+    for (int i=0; i<numTasks; i++) {
+        void *task = (char *)tasks + i*taskSize;
+        started[i] = (i > 0) && (pthread_create(&threads[i], NULL, function, task) == 0);
+    }
+
+    for (int i=0; i<numTasks; i++) {
+        if (!started[i])
+            function((char *)tasks + i*taskSize);
+    }
+    for (int i=0; i<numTasks; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+}
+
+// reads the keys of the rows and sorts them
+// every thread sorts its own part, then the parts are merged in pairs, also on the threads
+void sortKeys(table_t *table, const sort_order_t *order, int col, const int *rows, size_t length,
+        sort_key_t *keys, sort_key_t *buffer, int numThreads) {
+    size_t numParts = numThreads;
+    if (numParts > length / MIN_SORT_KEYS)
+        numParts = length / MIN_SORT_KEYS;
+    if (numParts < 1)
+        numParts = 1;
+
+    sort_task_t tasks[numParts];
+    size_t bounds[numParts+1];
+    for (size_t i=0; i<=numParts; i++)
+        bounds[i] = length * i / numParts;
+
+    for (size_t i=0; i<numParts; i++) {
+        tasks[i] = (sort_task_t){.table=*table, .order=order, .rows=rows, .keys=keys, .buffer=buffer,
+            .col=col, .begin=bounds[i], .end=bounds[i+1]};
+        STATS(tasks[i].table.stats = (stats_t){0};)
+    }
+    runTasks(&sortPart, tasks, sizeof(sort_task_t), numParts);
+#ifdef SHEET_STATS
+    for (size_t i=0; i<numParts; i++)
+        addStats(&table->stats, &tasks[i].table.stats);
+#endif
+
+    sort_key_t *result = keys;
+    while (numParts > 1) {
+        size_t numMerges = numParts / 2;
+        for (size_t i=0; i<numMerges; i++) {
+            tasks[i] = (sort_task_t){.order=order, .keys=keys, .buffer=buffer,
+                .begin=bounds[2*i], .middle=bounds[2*i+1], .end=bounds[2*i+2]};
+        }
+        runTasks(&mergePart, tasks, sizeof(sort_task_t), numMerges);
+
+        // odd part has no pair, it is only copied
+        if (numParts % 2 == 1) {
+            memcpy(&buffer[bounds[numParts-1]], &keys[bounds[numParts-1]],
+                (length - bounds[numParts-1]) * sizeof(sort_key_t));
+        }
+
+        for (size_t i=0; i<=numMerges; i++)
+            bounds[i] = bounds[2*i];
+        bounds[numMerges + numParts % 2] = length;
+        numParts = numMerges + numParts % 2;
+
+        sort_key_t *swap = keys;
+        keys = buffer;
+        buffer = swap;
+    }
+
+    // after odd number of rounds the keys are in the buffer
+    if (keys != result)
+        memcpy(result, keys, length * sizeof(sort_key_t));
+}
+
+// writes the sorted keys into a temporary file
+state_t writeSortRun(FILE *file, const sort_key_t *keys, size_t length) {
+    for (size_t i=0; i<length; i++) {
+        const sort_key_t *key = &keys[i];
+        if ((fwrite(&key->row, sizeof(int), 1, file) != 1)
+                || (fwrite(&key->isNumber, sizeof(bool), 1, file) != 1)
+                || (fwrite(&key->number, sizeof(double), 1, file) != 1)
+                || (fwrite(&key->length, sizeof(int), 1, file) != 1)
+                || (fwrite(key->text, 1, key->length, file) != (size_t)key->length))
+            return ERR_SORT_FILE;
+    }
+    if ((fflush(file) != 0) || (fseek(file, 0, SEEK_SET) != 0))
+        return ERR_SORT_FILE;
+    return SUCCESS;
+}
+
+// one sorted part of the keys written into a temporary file, see sortExternal()
+typedef struct {
+    FILE *file;
+    size_t left; // keys, which were not read yet
+    sort_key_t key; // the smallest key, which was not merged yet
+    char *text; // text of the key
+    int capacity;
+} sort_run_t;
+
+// reads the next key of the run
+state_t readSortRun(sort_run_t *run) {
+    sort_key_t *key = &run->key;
+    run->left--;
+    if ((fread(&key->row, sizeof(int), 1, run->file) != 1)
+            || (fread(&key->isNumber, sizeof(bool), 1, run->file) != 1)
+            || (fread(&key->number, sizeof(double), 1, run->file) != 1)
+            || (fread(&key->length, sizeof(int), 1, run->file) != 1) || (key->length < 0))
+        return ERR_SORT_FILE;
+
+    if (key->length > run->capacity) {
+        char *text = realloc(run->text, key->length);
+        if (text == NULL)
+            return ERR_NO_MEMORY;
+        run->text = text;
+        run->capacity = key->length;
+    }
+    if (fread(run->text, 1, key->length, run->file) != (size_t)key->length)
+        return ERR_SORT_FILE;
+    key->text = run->text;
+    return SUCCESS;
+}
+
+// is the key of run a smaller than the one of run b
+// runs are parts of the rows in their order, so equal keys of the earlier run go first
+bool isSmallerRun(sort_run_t *runs, int a, int b, const sort_order_t *order) {
+    int result = compareKeys(&runs[a].key, &runs[b].key, order);
+    return (result < 0) || ((result == 0) && (a < b));
+}
+
+// moves the run down the heap, until it is smaller than its children
+void siftRun(sort_run_t *runs, int *heap, int size, int i, const sort_order_t *order) {
+    while (true) {
+        int smallest = i;
+        for (int child=2*i+1; (child <= 2*i+2) && (child < size); child++) {
+            if (isSmallerRun(runs, heap[child], heap[smallest], order))
+                smallest = child;
+        }
+        if (smallest == i)
+            return;
+
+        int swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+// Sorts keys, which do not fit into memory
+// parts of them are sorted in memory and written into temporary files,
+// then all the files are merged at once, the rows are written into sorted in their final order
+state_t sortExternal(table_t *table, const sort_order_t *order, int col, const int *rows, size_t length,
+        size_t runLength, int numThreads, int *sorted) {
+    int numRuns = (length + runLength - 1) / runLength;
+    sort_run_t *runs = calloc(numRuns, sizeof(sort_run_t));
+    int *heap = malloc(numRuns * sizeof(int));
+    sort_key_t *keys = malloc(runLength * sizeof(sort_key_t));
+    sort_key_t *buffer = malloc(runLength * sizeof(sort_key_t));
+
+    state_t state = SUCCESS;
+    if ((runs == NULL) || (heap == NULL) || (keys == NULL) || (buffer == NULL))
+        state = ERR_NO_MEMORY;
+
+    for (int r=0; (r<numRuns) && (state == SUCCESS); r++) {
+        size_t begin = r * runLength;
+        size_t end = (begin + runLength < length) ? begin + runLength : length;
+
+        sortKeys(table, order, col, &rows[begin], end-begin, keys, buffer, numThreads);
+
+        runs[r].file = tmpfile();
+        runs[r].left = end-begin;
+        if (runs[r].file == NULL)
+            state = ERR_SORT_FILE;
+        else
+            state = writeSortRun(runs[r].file, keys, end-begin);
+        STATS(table->stats.bytes += (end-begin) * sizeof(sort_key_t);)
+    }
+
+    // memory of the keys is not needed during the merge
+    free(keys);
+    free(buffer);
+
+    int heapSize = 0;
+    for (int r=0; (r<numRuns) && (state == SUCCESS); r++) {
+        state = readSortRun(&runs[r]);
+        heap[heapSize++] = r;
+    }
+    for (int i=heapSize/2-1; (i>=0) && (state == SUCCESS); i--)
+        siftRun(runs, heap, heapSize, i, order);
+
+    for (size_t i=0; (i<length) && (state == SUCCESS); i++) {
+        sort_run_t *run = &runs[heap[0]];
+        sorted[i] = run->key.row;
+
+        // finished run is replaced by the last one in the heap
+        if (run->left > 0)
+            state = readSortRun(run);
+        else
+            heap[0] = heap[--heapSize];
+        siftRun(runs, heap, heapSize, 0, order);
+    }
+
+    for (int r=0; (runs != NULL) && (r<numRuns); r++) {
+        if (runs[r].file != NULL)
+            fclose(runs[r].file);
+        free(runs[r].text);
+    }
+    free(runs);
+    free(heap);
+    return state;
+}
+
+// Sorts the selected rows by the column among themselves, the other rows stay where they are
+// only the view of the rows is changed, the cells are not moved
+// keys are sorted on the threads of -j, with more keys than --sort-memory they are sorted in files
+state_t sortRows(table_t *table, step_t *step, plan_t *plan) {
+    const sort_order_t *order = step->data;
+    int col = step->parameters[0];
+
+    size_t length = countSelected(table);
+    if (length == 0)
+        return SUCCESS;
+
+    // the same as other data commands, the column is checked only with selected rows
+    if (!isValidColumn(table, col))
+        return ERR_OUT_OF_RANGE;
+
+    // selected rows in their order, and then in the sorted order
+    int *rows = malloc(length * sizeof(int));
+    int *sorted = malloc(length * sizeof(int));
+    state_t state = (rows != NULL) && (sorted != NULL) ? SUCCESS : ERR_NO_MEMORY;
+
+    size_t numRows = 0;
+    for (int row=nextSelectedRow(table, 0); (row != 0) && (state == SUCCESS); row=nextSelectedRow(table, row))
+        rows[numRows++] = row;
+
+    // the keys and the buffer for merging them have to fit
+    size_t runLength = plan->sortMemory / (2 * sizeof(sort_key_t));
+    if (runLength < MIN_SORT_KEYS)
+        runLength = MIN_SORT_KEYS;
+
+    if ((state == SUCCESS) && (length <= runLength)) {
+        sort_key_t *keys = malloc(length * sizeof(sort_key_t));
+        sort_key_t *buffer = malloc(length * sizeof(sort_key_t));
+        if ((keys == NULL) || (buffer == NULL)) {
+            state = ERR_NO_MEMORY;
+        } else {
+            sortKeys(table, order, col, rows, length, keys, buffer, plan->numThreads);
+            for (size_t i=0; i<length; i++)
+                sorted[i] = keys[i].row;
+        }
+        free(keys);
+        free(buffer);
+    } else if (state == SUCCESS) {
+        state = sortExternal(table, order, col, rows, length, runLength, plan->numThreads, sorted);
+    }
+
+    // data commands cannot be used after layout commands, so the view starts as it was read
+    if (state == SUCCESS)
+        state = makeView(table);
+    if (state == SUCCESS) {
+        for (size_t i=0; i<length; i++)
+            table->view->rows[rows[i]-1] = sorted[i];
+        STATS(countMoved(table, length);)
+    }
+
+    free(rows);
+    free(sorted);
+    return state;
+}
+
+// kinds of the aggregation commands
+typedef enum {
+    AGGREGATE_SUM,
+    AGGREGATE_AVG,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_COUNT
+} aggregate_kind_t;
+
+// state of one aggregation command
+typedef struct {
+    int target[2]; // row and column of the cell for the result, 0 0 for a table with only the result
+    double *values; // number of every row, NaN for rows, which are not selected or are not numbers
+} aggregation_t;
+
+// reads the optional cell for the result behind the column: csum C [R D]
+state_t readAggregateTarget(arguments_t *args, step_t *step) {
+    int target[2] = {0, 0};
+
+    // another command cannot follow the data command, so a number is the row of the cell
+    if (readInt(args, &target[0])) {
+        if (!readInt(args, &target[1]))
+            return ERR_BAD_SYNTAX;
+
+        if ((target[0] == 0) || (target[1] == 0))
+            return ERR_OUT_OF_RANGE;
+    }
+
+    aggregation_t *aggregation = malloc(sizeof(aggregation_t));
+    if (aggregation == NULL)
+        return ERR_NO_MEMORY;
+    aggregation->target[0] = target[0];
+    aggregation->target[1] = target[1];
+    aggregation->values = NULL;
+    step->data = aggregation;
+    return SUCCESS;
+}
+
+// frees the state of the aggregation command
+void freeAggregate(step_t *step) {
+    aggregation_t *aggregation = step->data;
+    if (aggregation != NULL)
+        free(aggregation->values);
+    free(aggregation);
+}
+
+// makes the array for the numbers of the column, before they are read in the pass over the table
+state_t prepareAggregate(table_t *table, step_t *step) {
+    aggregation_t *aggregation = step->data;
+    int numRows = countRows(table);
+
+    free(aggregation->values);
+    aggregation->values = malloc((numRows > 0 ? numRows : 1) * sizeof(double));
+    if (aggregation->values == NULL)
+        return ERR_NO_MEMORY;
+
+    for (int i=0; i<numRows; i++)
+        aggregation->values[i] = NAN;
+    return SUCCESS;
+}
+
+// reads the number of the selected row, every thread writes only the values of its own rows
+state_t readAggregateRow(table_t *table, step_t *step, int row) {
+    aggregation_t *aggregation = step->data;
+    int col = step->parameters[0];
+
+    if (!isValidColumn(table, col))
+        return ERR_OUT_OF_RANGE;
+
+    cell_t *cell = getCell(table, row, col);
+    double value;
+    if (readDouble(cell->text, cell->length, &value))
+        aggregation->values[row-1] = value;
+    return SUCCESS;
+}
+
+// writes the result of the aggregation as text, returns its length
+// or -1, if there were no numbers, sum and count of no numbers are 0, the rest does not exist
+int formatAggregate(aggregate_t *result, aggregate_kind_t kind, char *text, size_t size) {
+    if ((result->count == 0) && (kind != AGGREGATE_SUM) && (kind != AGGREGATE_COUNT))
+        return -1;
+
+    switch (kind) {
+        case AGGREGATE_SUM: return snprintf(text, size, "%.15g", result->sum);
+        case AGGREGATE_AVG: return snprintf(text, size, "%.15g", result->sum / result->count);
+        case AGGREGATE_MIN: return snprintf(text, size, "%.15g", result->min);
+        case AGGREGATE_MAX: return snprintf(text, size, "%.15g", result->max);
+        case AGGREGATE_COUNT: return snprintf(text, size, "%llu", (unsigned long long)result->count);
+    }
+    return -1;
+}
+
+// Aggregates the numbers read in the pass and writes the result
+// values are added up in blocks, which are added in their order,
+// so the result is the same with any number of threads and on any processor
+state_t aggregateRows(table_t *table, step_t *step, aggregate_kind_t kind) {
+    aggregation_t *aggregation = step->data;
+    int numRows = countRows(table);
+
+    aggregate_t result = {.sum = 0, .min = INFINITY, .max = -INFINITY, .count = 0};
+    for (int begin=0; begin<numRows; begin+=AGGREGATE_BLOCK) {
+        aggregate_t block = {.sum = 0, .min = result.min, .max = result.max, .count = 0};
+        aggregate(&aggregation->values[begin], (numRows-begin < AGGREGATE_BLOCK) ? numRows-begin : AGGREGATE_BLOCK,
+            &block);
+
+        result.sum += block.sum;
+        result.min = block.min;
+        result.max = block.max;
+        result.count += block.count;
+    }
+
+    char text[32];
+    int length = formatAggregate(&result, kind, text, sizeof(text));
+    if (length < 0)
+        return ERR_NO_NUMBERS;
+
+    int row = aggregation->target[0];
+    int col = aggregation->target[1];
+    if (row == 0) {
+        row = 1;
+        col = 1;
+    }
+
+    cell_t *cell = getCell(table, row, col);
+    if (cell == NULL)
+        return ERR_OUT_OF_RANGE;
+
+    state_t state = setCellText(table, cell, text, length);
+    if ((state != SUCCESS) || (aggregation->target[0] != 0))
+        return state;
+
+    // without the cell for the result, the table becomes only the result
+    state = makeView(table);
+    if (state != SUCCESS)
+        return state;
+
+    table->view->rows[0] = 1;
+    table->view->cols[0] = 1;
+    table->numRows = 1;
+    table->numCols = 1;
+    return SUCCESS;
+}
+
+state_t sumRows(table_t *table, step_t *step, plan_t *plan) {
+    (void)plan;
+    return aggregateRows(table, step, AGGREGATE_SUM);
+}
+
+state_t avgRows(table_t *table, step_t *step, plan_t *plan) {
+    (void)plan;
+    return aggregateRows(table, step, AGGREGATE_AVG);
+}
+
+state_t minRows(table_t *table, step_t *step, plan_t *plan) {
+    (void)plan;
+    return aggregateRows(table, step, AGGREGATE_MIN);
+}
+
+state_t maxRows(table_t *table, step_t *step, plan_t *plan) {
+    (void)plan;
+    return aggregateRows(table, step, AGGREGATE_MAX);
+}
+
+state_t countRowsWithNumbers(table_t *table, step_t *step, plan_t *plan) {
+    (void)plan;
+    return aggregateRows(table, step, AGGREGATE_COUNT);
+}
+
+// state of the groupby command
+typedef struct {
+    aggregate_kind_t kind;
+    int column; // column of the aggregated numbers
+} grouping_t;
+
+// one distinct key of the groupby command with the aggregate of its numbers
+typedef struct {
+    char *text;
+    int length;
+    uint64_t hash;
+    size_t first; // index of its first row, groups are printed in the order of their first rows
+    aggregate_t result;
+} group_t;
+
+// groups of one partition of the keys, built by one thread, see groupRows()
+typedef struct {
+    table_t table; // copy of the table, its counters are added to the table after the threads
+    const grouping_t *grouping;
+    int key;
+    const int *rows; // selected rows
+    uint64_t *hashes; // hash of the key of every selected row
+    size_t numRows;
+    size_t begin; // rows hashed by the thread
+    size_t end;
+    int part;
+    int numParts;
+    group_t *groups;
+    size_t numGroups;
+    size_t groupCapacity;
+    int *slots; // open addressing hash table, index of the group + 1, 0 for an empty slot
+    size_t numSlots;
+    state_t state;
+} group_part_t;
+
+// reads the aggregation and its column behind the key column: groupby K csum C
+state_t readGrouping(arguments_t *args, step_t *step) {
+    const char *names[] = {"csum", "cavg", "cmin", "cmax", "ccount"};
+    const aggregate_kind_t kinds[] = {AGGREGATE_SUM, AGGREGATE_AVG, AGGREGATE_MIN, AGGREGATE_MAX, AGGREGATE_COUNT};
+
+    if (args->index >= args->argc)
+        return ERR_BAD_SYNTAX;
+
+    int kind = -1;
+    for (int i=0; i<5; i++) {
+        if (strcmp(args->argv[args->index], names[i]) == 0)
+            kind = i;
+    }
+    if (kind < 0)
+        return ERR_BAD_SYNTAX;
+    args->index++;
+
+    int column;
+    if (!readInt(args, &column))
+        return ERR_BAD_SYNTAX;
+
+    grouping_t *grouping = malloc(sizeof(grouping_t));
+    if (grouping == NULL)
+        return ERR_NO_MEMORY;
+    grouping->kind = kinds[kind];
+    grouping->column = column;
+    step->data = grouping;
+    return SUCCESS;
+}
+
+// frees the state of the groupby command
+void freeGrouping(step_t *step) {
+    free(step->data);
+}
+
+// FNV-1a hash of the text of the key
+uint64_t hashKey(const char *text, int length) {
+    uint64_t hash = 14695981039346656037u;
+    for (int i=0; i<length; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211u;
+    return hash;
+}
+
+// partition of the key, the slot in its hash table is chosen by the low bits
+int keyPart(uint64_t hash, int numParts) {
+    return (hash >> 32) % numParts;
+}
+
+// function run by the threads, hashes the keys of a part of the rows
+void *hashGroupKeys(void *arg) {
+    group_part_t *part = arg;
+    for (size_t i=part->begin; i<part->end; i++) {
+        cell_t *cell = getCell(&part->table, part->rows[i], part->key);
+        part->hashes[i] = hashKey(cell->text, cell->length);
+    }
+    return NULL;
+}
+
+// makes the hash table of the part twice as big and puts the groups into it again
+state_t growSlots(group_part_t *part) {
+    size_t numSlots = (part->numSlots > 0) ? 2 * part->numSlots : 1024;
+    int *slots = calloc(numSlots, sizeof(int));
+    if (slots == NULL)
+        return ERR_NO_MEMORY;
+
+    for (size_t g=0; g<part->numGroups; g++) {
+        size_t slot = part->groups[g].hash & (numSlots - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (numSlots - 1);
+        slots[slot] = g + 1;
+    }
+
+    free(part->slots);
+    part->slots = slots;
+    part->numSlots = numSlots;
+    return SUCCESS;
+}
+
+// returns the group of the key, a new one is added, if there is none
+// or NULL pointer, if there is not enough memory
+group_t *findGroup(group_part_t *part, cell_t *cell, uint64_t hash, size_t first) {
+    size_t slot = hash & (part->numSlots - 1);
+    while (part->slots[slot] != 0) {
+        group_t *group = &part->groups[part->slots[slot] - 1];
+        if ((group->hash == hash) && (group->length == cell->length)
+                && (memcmp(group->text, cell->text, cell->length) == 0))
+            return group;
+        slot = (slot + 1) & (part->numSlots - 1);
+    }
+
+    if (part->numGroups == part->groupCapacity) {
+        size_t capacity = (part->groupCapacity > 0) ? 2 * part->groupCapacity : 256;
+        group_t *groups = realloc(part->groups, capacity * sizeof(group_t));
+        if (groups == NULL)
+            return NULL;
+        part->groups = groups;
+        part->groupCapacity = capacity;
+    }
+
+    group_t *group = &part->groups[part->numGroups++];
+    *group = (group_t){.text = cell->text, .length = cell->length, .hash = hash, .first = first,
+        .result = {.sum = 0, .min = INFINITY, .max = -INFINITY, .count = 0}};
+    part->slots[slot] = part->numGroups;
+
+    // the table is kept at most half full
+    if (2 * part->numGroups > part->numSlots) {
+        if (growSlots(part) != SUCCESS)
+            return NULL;
+        group = &part->groups[part->numGroups - 1];
+    }
+    return group;
+}
+
+// function run by the threads, builds the groups of one partition
+// rows are gone through in their order, so the numbers of a group are added up in the same order with any -j
+void *buildGroups(void *arg) {
+    group_part_t *part = arg;
+    part->state = growSlots(part);
+
+    for (size_t i=0; (i<part->numRows) && (part->state == SUCCESS); i++) {
+        if (keyPart(part->hashes[i], part->numParts) != part->part)
+            continue;
+
+        group_t *group = findGroup(part, getCell(&part->table, part->rows[i], part->key), part->hashes[i], i);
+        if (group == NULL) {
+            part->state = ERR_NO_MEMORY;
+            break;
+        }
+
+        cell_t *cell = getCell(&part->table, part->rows[i], part->grouping->column);
+        double value;
+        if (!readDouble(cell->text, cell->length, &value))
+            continue;
+
+        group->result.sum += value;
+        if (value < group->result.min)
+            group->result.min = value;
+        if (value > group->result.max)
+            group->result.max = value;
+        group->result.count++;
+    }
+    return NULL;
+}
+
+// for qsort(), groups go in the order of their first rows
+int compareGroups(const void *a, const void *b) {
+    const group_t *first = *(group_t * const *)a;
+    const group_t *second = *(group_t * const *)b;
+    return (first->first > second->first) - (first->first < second->first);
+}
+
+// replaces the table with one row for every group: the key and the aggregate of its numbers
+// aggregate of a group without numbers is an empty cell
+state_t writeGroups(table_t *table, group_part_t *parts, int numParts, grouping_t *grouping) {
+    size_t numGroups = 0;
+    for (int p=0; p<numParts; p++)
+        numGroups += parts[p].numGroups;
+
+    group_t **groups = malloc((numGroups > 0 ? numGroups : 1) * sizeof(group_t *));
+    cell_t *cells = malloc((numGroups > 0 ? 2 * numGroups : 1) * sizeof(cell_t));
+    if ((groups == NULL) || (cells == NULL) || (numGroups > INT_MAX)) {
+        free(groups);
+        free(cells);
+        return ERR_NO_MEMORY;
+    }
+
+    size_t n = 0;
+    for (int p=0; p<numParts; p++) {
+        for (size_t g=0; g<parts[p].numGroups; g++)
+            groups[n++] = &parts[p].groups[g];
+    }
+    qsort(groups, numGroups, sizeof(group_t *), &compareGroups);
+
+    if (!table->sharedCells)
+        free(table->cells);
+    table->cells = cells;
+    table->cellCapacity = (numGroups > 0) ? 2 * numGroups : 1;
+    table->sharedCells = false;
+    table->byColumns = false;
+    table->numRows = numGroups;
+    table->numCols = 2;
+
+    state_t state = SUCCESS;
+    for (size_t g=0; g<numGroups; g++) {
+        cells[2*g] = (cell_t){.text = groups[g]->text, .length = groups[g]->length};
+        cells[2*g+1] = emptyCell;
+
+        char text[32];
+        int length = formatAggregate(&groups[g]->result, grouping->kind, text, sizeof(text));
+        if ((length > 0) && (state == SUCCESS))
+            state = setCellText(table, &cells[2*g+1], text, length);
+    }
+
+    free(groups);
+    return state;
+}
+
+// Groups the selected rows by the key column and aggregates the numbers in the other column for every group
+// keys are hashed on the threads of -j, then every thread builds the groups of keys in its partition,
+// so no locks are needed and the result is the same with any number of threads
+state_t groupRows(table_t *table, step_t *step, plan_t *plan) {
+    grouping_t *grouping = step->data;
+    int key = step->parameters[0];
+
+    size_t numRows = countSelected(table);
+    if ((numRows > 0) && (!isValidColumn(table, key) || !isValidColumn(table, grouping->column)))
+        return ERR_OUT_OF_RANGE;
+
+    int numParts = plan->numThreads;
+    if ((size_t)numParts > numRows / MIN_GROUP_ROWS)
+        numParts = numRows / MIN_GROUP_ROWS;
+    if (numParts < 1)
+        numParts = 1;
+
+    int *rows = malloc((numRows > 0 ? numRows : 1) * sizeof(int));
+    uint64_t *hashes = malloc((numRows > 0 ? numRows : 1) * sizeof(uint64_t));
+    group_part_t *parts = calloc(numParts, sizeof(group_part_t));
+    state_t state = ((rows != NULL) && (hashes != NULL) && (parts != NULL)) ? SUCCESS : ERR_NO_MEMORY;
+
+    if (state == SUCCESS) {
+        size_t n = 0;
+        for (int row=nextSelectedRow(table, 0); row != 0; row=nextSelectedRow(table, row))
+            rows[n++] = row;
+
+        for (int p=0; p<numParts; p++) {
+            parts[p] = (group_part_t){.table=*table, .grouping=grouping, .key=key, .rows=rows, .hashes=hashes,
+                .numRows=numRows, .begin=numRows*p/numParts, .end=numRows*(p+1)/numParts,
+                .part=p, .numParts=numParts, .state=SUCCESS};
+            STATS(parts[p].table.stats = (stats_t){0};)
+        }
+        runTasks(&hashGroupKeys, parts, sizeof(group_part_t), numParts);
+        runTasks(&buildGroups, parts, sizeof(group_part_t), numParts);
+
+        for (int p=0; p<numParts; p++) {
+            if (state == SUCCESS)
+                state = parts[p].state;
+            STATS(addStats(&table->stats, &parts[p].table.stats);)
+        }
+    }
+
+    if (state == SUCCESS)
+        state = writeGroups(table, parts, numParts, grouping);
+
+    for (int p=0; (parts != NULL) && (p<numParts); p++) {
+        free(parts[p].groups);
+        free(parts[p].slots);
+    }
+    free(parts);
+    free(rows);
+    free(hashes);
+    return state;
+}
+
+// select all rows of the table
+// different form all the selection functions
+// assigns the value directly, whereas the other functions use and operator
+state_t selectAll(table_t *table) {
+    int numRows = countRows(table);
+    size_t numWords = selectionWords(numRows);
+
+    uint64_t *rowSelected = realloc(table->rowSelected, (numWords > 0 ? numWords : 1) * sizeof(uint64_t));
+    if (rowSelected == NULL)
+        return ERR_NO_MEMORY;
+    table->rowSelected = rowSelected;
+
+    for (size_t w=0; w<numWords; w++)
+        table->rowSelected[w] = ~(uint64_t)0;
+
+    // bits behind the last row must stay zero
+    if (numRows % WORD_BITS != 0)
+        table->rowSelected[numWords-1] = ((uint64_t)1 << (numRows % WORD_BITS)) - 1;
+
+    return SUCCESS;
+}
+
+// reads command's parameters from args into the step
+state_t readParameters(command_t *command, arguments_t *args, step_t *step) {
+    step->command = command;
+    step->strParameter = NULL;
+    step->strLength = 0;
+    step->data = NULL;
+    STATS(step->stats = (stats_t){0};)
+
+    for (int k=0; k < command->numParameters; k++) {
+        if (!readInt(args, &step->parameters[k])) {
+            return ERR_BAD_SYNTAX;
+        }
+    }
+
+    // there is only one type of command with string, it is the last parameter
+    if (command->hasStringParameter) {
+        if (args->index >= args->argc)
+            return ERR_BAD_SYNTAX;
+
+        step->strParameter = args->argv[args->index];
+        step->strLength = strlen(step->strParameter);
+        args->index++;
+    }
+
+    if (command->fnOptions != NULL)
+        return command->fnOptions(args, step);
+    return SUCCESS;
+}
+
+// executes one layout command
+state_t executeLayout(table_t *table, step_t *step) {
+    command_t *command = step->command;
+
+    if (command->fnStep != NULL)
+        return command->fnStep(table, step);
+
+    switch (command->numParameters) {
+        case 0: return command->fnZero(table);
+        case 1: return command->fnOne(table, step->parameters[0]);
+        case 2: return command->fnTwo(table, step->parameters[0], step->parameters[1]);
+    }
+    return ERR_GENERIC;
+}
+
+// Can these two commands be after each other
+bool isValidOrder (type_of_command_t currentCommand, type_of_command_t lastCommand) {
+    switch (lastCommand) {
+        case NOT_SET:
+            return true;
+        case LAYOUT:
+            // there can be only layout command
+            if (currentCommand == LAYOUT)
+                return true;
+            break;
+
+        case DATA:
+            // there can be only data command
+            return false;
+            break;
+
+        case SELECTION:
+            // there can be another selection or data command
+            if ((currentCommand == DATA) || (currentCommand == SELECTION))
+                return true;
+            break;
+
+        default: // should never happen
+            break;
     }
-
-    return SUCCESS;
+    return false;
 }
 
-// Prints the table into stdout
-void printTable(table_t *table) {
-    printf("%s", table->data);
+// all commands the program knows
+command_t commands[NUM_COMMANDS] = {
+    {.type=LAYOUT, .name="irow", .numParameters=1, .fnOne=irow},
+    {.type=LAYOUT, .name="arow", .numParameters=0, .fnZero=arow},
+    {.type=LAYOUT, .name="drow", .numParameters=1, .fnOne=drow},
+    {.type=LAYOUT, .name="drows", .numParameters=2, .fnTwo=drows},
+    {.type=LAYOUT, .name="icol", .numParameters=1, .fnOne=icol},
+    {.type=LAYOUT, .name="acol", .numParameters=0, .fnZero=acol},
+    {.type=LAYOUT, .name="dcol", .numParameters=1, .fnOne=dcol},
+    {.type=LAYOUT, .name="dcols", .numParameters=2, .fnTwo=dcols},
+    {.type=LAYOUT, .name="project", .numParameters=0, .hasStringParameter=true, .fnStep=project,
+        .fnCompile=compileProject, .fnFree=freeProject},
+
+    {.type=DATA, .name="cset", .numParameters=1, .hasStringParameter=true, .fnRow=setRow},
+    {.type=DATA, .name="tolower", .numParameters=1, .fnRow=lowerRow},
+    {.type=DATA, .name="toupper", .numParameters=1, .fnRow=upperRow},
+    {.type=DATA, .name="round", .numParameters=1, .fnRow=roundRow},
+    {.type=DATA, .name="int", .numParameters=1, .fnRow=intRow},
+    {.type=DATA, .name="copy", .numParameters=2, .fnRow=copyRow},
+    {.type=DATA, .name="swap", .numParameters=2, .fnRow=swapRow},
+    {.type=DATA, .name="move", .numParameters=2, .fnRow=moveRow},
+    {.type=DATA, .name="sort", .numParameters=1, .fnTable=sortRows,
+        .fnOptions=readSortOrder, .fnFree=freeSortOrder},
+    {.type=DATA, .name="csum", .numParameters=1, .fnCheck=prepareAggregate, .fnRow=readAggregateRow,
+        .fnTable=sumRows, .fnOptions=readAggregateTarget, .fnFree=freeAggregate},
+    {.type=DATA, .name="cavg", .numParameters=1, .fnCheck=prepareAggregate, .fnRow=readAggregateRow,
+        .fnTable=avgRows, .fnOptions=readAggregateTarget, .fnFree=freeAggregate},
+    {.type=DATA, .name="cmin", .numParameters=1, .fnCheck=prepareAggregate, .fnRow=readAggregateRow,
+        .fnTable=minRows, .fnOptions=readAggregateTarget, .fnFree=freeAggregate},
+    {.type=DATA, .name="cmax", .numParameters=1, .fnCheck=prepareAggregate, .fnRow=readAggregateRow,
+        .fnTable=maxRows, .fnOptions=readAggregateTarget, .fnFree=freeAggregate},
+    {.type=DATA, .name="ccount", .numParameters=1, .fnCheck=prepareAggregate, .fnRow=readAggregateRow,
+        .fnTable=countRowsWithNumbers, .fnOptions=readAggregateTarget, .fnFree=freeAggregate},
+    {.type=DATA, .name="groupby", .numParameters=1, .fnTable=groupRows,
+        .fnOptions=readGrouping, .fnFree=freeGrouping},
+
+    {.type=SELECTION, .name="rows", .numParameters=2, .fnCheck=checkRows, .fnSelect=selectRows},
+    {.type=SELECTION, .name="beginswith", .numParameters=1, .hasStringParameter=true,
+        .fnCheck=checkColumn, .fnSelect=selectBeginsWith},
+    {.type=SELECTION, .name="contains", .numParameters=1, .hasStringParameter=true,
+        .fnCheck=checkColumn, .fnSelect=selectContains},
+    {.type=SELECTION, .name="containsany", .numParameters=1, .hasStringParameter=true,
+        .fnCheck=checkColumn, .fnSelect=selectPatterns, .fnCompile=compileAnyPatterns, .fnFree=freePatterns},
+    {.type=SELECTION, .name="containsall", .numParameters=1, .hasStringParameter=true,
+        .fnCheck=checkColumn, .fnSelect=selectPatterns, .fnCompile=compileAllPatterns, .fnFree=freePatterns},
+    {.type=SELECTION, .name="matches", .numParameters=1, .hasStringParameter=true,
+        .fnCheck=checkColumn, .fnSelect=selectMatches, .fnCompile=compileRegex, .fnFree=freeRegex}
+};
+
+// returns the command with given name
+// or NULL pointer, if there is no such command
+command_t *findCommand(char *name) {
+    for (int i=0; (i<NUM_COMMANDS) && (commands[i].name[0] != '\0'); i++) {
+        if (strcmp(commands[i].name, name) == 0)
+            return &commands[i];
+    }
+    return NULL;
 }
 
-// tries to read int from current argument
-// if it succeeds returns true and increments argument index
-// if there is -, the function assigns DASH_NUMBER constant
-bool readInt(arguments_t *args, int *n) {
-    if (args->index >= args->argc)
-        return false;
+// takes in arguments and recognizes commands
+// the whole plan is read and checked before the table, so syntax errors are found before any work is done
+state_t parseCommands(arguments_t *args, plan_t *plan) {
+    plan->steps = NULL;
+    plan->numSteps = 0;
+    plan->numThreads = 1;
+    plan->sortMemory = (size_t)SORT_MEMORY_MB << 20;
+    STATS(plan->stats = false;)
+    STATS(plan->readStats = (stats_t){0};)
+    STATS(plan->printStats = (stats_t){0};)
 
-    // special case for -
-    if (strcmp(args->argv[args->index], "-") == 0) {
-        *n = DASH_NUMBER;
-        args->index++;
-        return true;
-    }
+    if (args->index >= args->argc)
+        return NOT_FOUND;
 
-    char *pEnd;
-    *n = strtol(args->argv[args->index], &pEnd, 10);
-    if (*pEnd != '\0')
-        return false;
+    // every command takes at least one argument
+    plan->steps = malloc((args->argc - args->index) * sizeof(step_t));
+    if (plan->steps == NULL)
+        return ERR_NO_MEMORY;
 
-    args->index++;
-    return true;
-}
+    type_of_command_t lastCommandType = NOT_SET;
+    while (args->index < args->argc) {
+        command_t *command = findCommand(args->argv[args->index]);
 
-// takes a float and rounds it
-int roundNumber(float num) {
-    if (num < 0)
-        return num - 0.5;
+        // if no command is found, it is bad syntax
+        if (command == NULL)
+            return ERR_BAD_SYNTAX;
 
-    return num + 0.5;
-}
+        args->index++; //successfully found a valid command
+        if (!isValidOrder(command->type, lastCommandType))
+            return ERR_BAD_ORDER;
 
-// takes in string
-// if there is a number inside,
-// the function rounds it and writes it back to the string
-void roundLine(char *buffer) {
-    char *pEnd;
-    double num = strtod(buffer, &pEnd);
+        step_t *step = &plan->steps[plan->numSteps];
+        state_t state = readParameters(command, args, step);
+        if ((state == SUCCESS) && (command->fnCompile != NULL))
+            state = command->fnCompile(step, plan);
+        if (state != SUCCESS)
+            return state;
 
-    if (*pEnd == '\0') {
-        // if the input value is valid
-        sprintf(buffer, "%d", roundNumber(num));
+        plan->numSteps++;
+        lastCommandType = command->type;
     }
+    return SUCCESS;
 }
 
-// takes in string
-// if there is a number in it,
-// the function makes integer out of the number and writes it back to the string
-void intLine(char *buffer) {
-    char *pEnd;
-    double num = strtod(buffer, &pEnd);
-
-    if (*pEnd == '\0') {
-        // if the reading worked fine
-        // and there's only number in the cell
-        sprintf(buffer, "%d", (int)num);
+// frees memory of the plan
+void freePlan(plan_t *plan) {
+    for (int i=0; i<plan->numSteps; i++) {
+        if (plan->steps[i].command->fnFree != NULL)
+            plan->steps[i].command->fnFree(&plan->steps[i]);
     }
+    free(plan->steps);
+    plan->steps = NULL;
+    plan->numSteps = 0;
 }
 
-// takes in string and makes it uppercase
-void upperLine(char *buffer) {
-    int i=0;
-    do {
-        if ((buffer[i]>='a') && (buffer[i]<='z'))
-            buffer[i] -= 'a'-'A';
-    } while (buffer[i++] != '\0');
-}
+// runs the selection commands and the data command at their end on the words of the chunk
+state_t executeWords(chunk_t *chunk) {
+    plan_t *plan = chunk->plan;
+    table_t *table = &chunk->table;
 
-// takes in string and makes it lowercase
-void lowerLine(char *buffer) {
-    int i=0;
-    do {
-        if ((buffer[i]>='A') && (buffer[i]<='Z'))
-            buffer[i] += 'a'-'A';
-    } while (buffer[i++] != '\0');
-}
+    // data command can only be the last one
+    step_t *data = &plan->steps[plan->numSteps-1];
+    int numSelections = plan->numSteps;
+    if (data->command->type == DATA)
+        numSelections--;
 
-// modifies each cell of the column, but only if it lies in the chosen row
-// The string in cell is modified with the modFunction
-state_t modifyData(table_t *table, int col, void(*modFunction)(char *)) {
-    int numRows = countRows(table);
-    for (int row=1; row<=numRows; row++) {
-        if (table->rowSelected[row]) {
-            char buffer[MAX_CELL_LENGTH];
-            state_t state;
+    // data command working with all rows at once is run after the pass
+    if (data->command->fnRow == NULL)
+        data = NULL;
 
-            state = readCell(table, row, col, buffer);
-            if (state != SUCCESS)
-                return state;
+    for (size_t w=chunk->firstWord; w<chunk->endWord; w++) {
+        uint64_t bits = table->rowSelected[w];
+
+        for (int i=0; (i<numSelections) && (bits != 0); i++) {
+            STATS(uint64_t start = startStats(plan);)
+            STATS(int rows = countBits(bits);)
+
+            bits = plan->steps[i].command->fnSelect(table, &plan->steps[i], w, bits);
 
-            modFunction(buffer);
+            STATS(stopStats(plan, table, &chunk->stepStats[i], start, rows);)
+        }
+
+        table->rowSelected[w] = bits;
+        if (data == NULL)
+            continue;
+
+        STATS(uint64_t start = startStats(plan);)
+        STATS(int rows = countBits(bits);)
 
-            writeCell(table, row, col, buffer);
+        while (bits != 0) {
+            int bit = countTrailingZeros(bits);
+            bits &= bits - 1;
+
+            state_t state = data->command->fnRow(table, data, w*WORD_BITS + bit + 1);
+            if (state != SUCCESS)
+                return state;
         }
+
+        STATS(stopStats(plan, table, &chunk->stepStats[plan->numSteps-1], start, rows);)
     }
     return SUCCESS;
 }
 
-// all of these functions use modifyData()
-state_t upperColumn(table_t *table, int col) {
-    return modifyData(table, col, &upperLine);
+// function run by the threads
+void *executeChunk(void *arg) {
+    chunk_t *chunk = arg;
+    chunk->state = executeWords(chunk);
+    return NULL;
 }
 
-state_t lowerColumn(table_t *table, int col) {
-    return modifyData(table, col, &lowerLine);
-}
+// splits the words of the selection between the threads
+// every row is processed by one thread only and commands change only cells of their row,
+// so the threads do not need any locks, only the text of cells is written into separate blocks
+state_t executeParallel(plan_t *plan, table_t *table, size_t numWords) {
+    size_t numThreads = plan->numThreads;
+    if (numThreads > numWords / MIN_THREAD_WORDS)
+        numThreads = numWords / MIN_THREAD_WORDS;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    chunk_t chunks[numThreads];
+    pthread_t threads[numThreads];
+    bool started[numThreads];
+    STATS(stats_t stepStats[numThreads * plan->numSteps];)
+    STATS(memset(stepStats, 0, sizeof(stepStats));)
+
+    for (size_t i=0; i<numThreads; i++) {
+        chunks[i].plan = plan;
+        chunks[i].table = *table;
+        chunks[i].table.blocks = NULL;
+        chunks[i].firstWord = numWords * i / numThreads;
+        chunks[i].endWord = numWords * (i+1) / numThreads;
+        chunks[i].state = SUCCESS;
+        STATS(chunks[i].stepStats = &stepStats[i * plan->numSteps];)
+
+        // the first chunk is left for this thread
+        started[i] = (i > 0) && (pthread_create(&threads[i], NULL, &executeChunk, &chunks[i]) == 0);
+    }
 
-state_t roundColumn(table_t *table, int col) {
-    return modifyData(table, col, &roundLine);
-}
+    // chunks, which did not get a thread, are done here
+    for (size_t i=0; i<numThreads; i++) {
+        if (!started[i])
+            executeChunk(&chunks[i]);
+    }
 
-state_t intColumn(table_t *table, int col) {
-    return modifyData(table, col, &intLine);
-}
+    state_t state = SUCCESS;
+    for (size_t i=0; i<numThreads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
 
-// functions to rewrite data in columns
-state_t setColumn(table_t *table, int col, char *content) {
-    int numRows = countRows(table);
+        // the blocks of the thread become part of the table
+        block_t *blocks = chunks[i].table.blocks;
+        if (blocks != NULL) {
+            block_t *last = blocks;
+            while (last->next != NULL)
+                last = last->next;
 
-    for (int row=1; row<=numRows; row++) {
-        if (table->rowSelected[row]) {
-            state_t state = writeCell(table, row, col, content);
-            if (state != SUCCESS)
-                return state;
+            last->next = table->blocks;
+            table->blocks = blocks;
         }
+
+        // the same error as in the serial pass, the one of the first row
+        if (state == SUCCESS)
+            state = chunks[i].state;
+
+#ifdef SHEET_STATS
+        for (int k=0; k<plan->numSteps; k++)
+            addStats(&plan->steps[k].stats, &chunks[i].stepStats[k]);
+#endif
     }
-    return SUCCESS;
+    return state;
 }
 
-state_t copyColumn(table_t *table, int srcCol, int destCol) {
-    int numRows = countRows(table);
+// layout commands are executed one after another
+// selection commands and the data command at their end are done in a single pass over the table:
+// for every word of the selection all the selection commands are applied first,
+// then the data command processes the rows left selected, while they are still in cache
+state_t executePlan(plan_t *plan, table_t *table) {
+    state_t state;
+
+    if (plan->steps[0].command->type == LAYOUT) {
+        for (int i=0; i<plan->numSteps; i++) {
+            STATS(uint64_t start = startStats(plan);)
+            STATS(int rows = countRows(table);)
+
+            state = executeLayout(table, &plan->steps[i]);
 
-    for (int row=1; row<=numRows; row++) {
-        if (table->rowSelected[row]) {
-            char buffer[MAX_CELL_LENGTH];
-            state_t state = readCell(table, row, srcCol, buffer);
+            STATS(stopStats(plan, table, &plan->steps[i].stats, start, rows);)
             if (state != SUCCESS)
                 return state;
+        }
+        return SUCCESS;
+    }
 
-            state = writeCell(table, row, destCol, buffer);
+    for (int i=0; i<plan->numSteps; i++) {
+        step_t *step = &plan->steps[i];
+        if (step->command->fnCheck != NULL) {
+            state = step->command->fnCheck(table, step);
             if (state != SUCCESS)
                 return state;
         }
     }
+
+    // by default all rows are selected
+    state = selectAll(table);
+    if (state != SUCCESS)
+        return state;
+
+    state = executeParallel(plan, table, selectionWords(countRows(table)));
+
+    step_t *last = &plan->steps[plan->numSteps-1];
+    if ((state == SUCCESS) && (last->command->fnTable != NULL)) {
+        STATS(uint64_t start = startStats(plan);)
+        // rows read by fnRow in the pass are counted already
+        STATS(int rows = (last->command->fnRow == NULL) ? countSelected(table) : 0;)
+
+        state = last->command->fnTable(table, last, plan);
+
+        STATS(stopStats(plan, table, &last->stats, start, rows);)
+    }
+    return state;
+}
+
+// forgets text of all edited cells, the newest block is kept for reuse
+void resetText(table_t *table) {
+    block_t *newest = table->blocks;
+    if (newest == NULL)
+        return;
+
+    table->blocks = newest->next;
+    freeText(table);
+
+    newest->next = NULL;
+    newest->used = 0;
+    table->blocks = newest;
+}
+
+// replaces the table's only row with the text, runs the commands on it and prints it
+// the number of columns has to be the same as in the previous rows
+state_t streamRow(plan_t *plan, table_t *table, output_t *output,
+        const unsigned char classes[256], char *text, size_t length) {
+    table->numRows = 0;
+    resetText(table);
+
+    STATS(uint64_t start = startStats(plan);)
+    state_t state = parseRows(table, classes, text, length);
+    STATS(table->stats.bytes += length;)
+    STATS(stopStats(plan, table, &plan->readStats, start, 1);)
+    if (state != SUCCESS)
+        return state;
+
+    // the same plan is executed on every row
+    state = executePlan(plan, table);
+    if (state != SUCCESS)
+        return state;
+
+    STATS(start = startStats(plan);)
+    state = printTable(table, output);
+    STATS(stopStats(plan, table, &plan->printStats, start, 1);)
+    if (state != SUCCESS)
+        return state;
+
+    table->firstRow++;
     return SUCCESS;
 }
 
-state_t swapColumn(table_t *table, int col1, int col2) {
-    int numRows = countRows(table);
+// Reads the table from stdin one row at a time
+// every row is processed and printed before the next one is read,
+// so memory usage does not depend on the size of the table
+state_t streamTable(plan_t *plan, options_t *options, table_t *table, output_t *output) {
+    // layout commands and sort need the whole table
+    if ((plan->steps[0].command->type == LAYOUT) || (plan->steps[plan->numSteps-1].command->fnTable != NULL))
+        return ERR_NOT_STREAMABLE;
+
+    // empty rows are held back, because they are dropped at the end of the table
+    int emptyRows = 0;
+
+    initTable(table, options->delimiters[0]);
+
+    unsigned char classes[256];
+    buildCharClasses(options->delimiters, classes);
+
+    // rows are sent on, whenever the program has to wait for the input
+    output->copyAll = true;
+    table->input.output = output;
+
+    input_t *input = &table->input;
+    state_t state;
+    size_t length;
+
+    // the rows command has to know the last row, so every row waits until the next one is read
+    bool holdBack = false;
+    for (int i=0; i<plan->numSteps; i++)
+        holdBack = holdBack || (plan->steps[i].command->fnCheck == &checkRows);
+    table->streaming = true;
+
+    char *held = NULL;
+    size_t heldLength = 0;
+    size_t heldCapacity = 0;
+    bool isHeld = false;
+
+    while ((state = nextRow(input, classes, &length)) == SUCCESS) {
+        // end of input
+        if (length == 0)
+            break;
+
+        // the row stays in the buffer until the next call of nextRow()
+        char *text = &input->buffer[input->position];
+        input->position += length;
 
-    for (int row=1; row<=numRows; row++) {
-        if (table->rowSelected[row]) {
-            char content1[MAX_CELL_LENGTH];
-            char content2[MAX_CELL_LENGTH];
-            state_t state;
+        // \n is not part of the row
+        if (classes[(unsigned char)text[length-1]] == CHAR_NEWLINE)
+            length--;
+
+        if (length == 0) {
+            emptyRows++;
+            continue;
+        }
 
-            state = readCell(table, row, col1, content1);
+        // row held back is in front of the empty rows
+        if (isHeld) {
+            state = streamRow(plan, table, output, classes, held, heldLength);
+            isHeld = false;
             if (state != SUCCESS)
-                return state;
+                break;
+        }
 
-            state = readCell(table, row, col2, content2);
+        // process empty rows held back and then continue with the current one
+        for (; (emptyRows > 0) && (state == SUCCESS); emptyRows--)
+            state = streamRow(plan, table, output, classes, "", 0);
+        if (state != SUCCESS)
+            break;
+
+        if (!holdBack) {
+            state = streamRow(plan, table, output, classes, text, length);
             if (state != SUCCESS)
-                return state;
+                break;
+            continue;
+        }
 
-            writeCell(table, row, col1, content2);
-            writeCell(table, row, col2, content1);
+        if (length > heldCapacity) {
+            char *newHeld = realloc(held, length);
+            if (newHeld == NULL) {
+                state = ERR_NO_MEMORY;
+                break;
+            }
+            held = newHeld;
+            heldCapacity = length;
         }
+        memcpy(held, text, length);
+        heldLength = length;
+        isHeld = true;
     }
-    return SUCCESS;
-}
 
-state_t moveColumn(table_t *table, int n, int m) {
-    int pos = n;
-    int endPos = m;
-    if (n < m)
-        endPos--;
+    // empty rows at the end are dropped, so the held row is the last one
+    if ((state == SUCCESS) && isHeld) {
+        table->lastRow = true;
+        state = streamRow(plan, table, output, classes, held, heldLength);
+    }
+    free(held);
 
-    // not really efficient, lower level implementation would be faster
-    while (pos != endPos) {
-        // direction is -1 or +1
-        int direction = 2*(pos < endPos) - 1;
+    if ((state == SUCCESS) && (table->firstRow == 1))
+        return ERR_TABLE_EMPTY;
 
-        state_t state = swapColumn(table, pos, pos + direction);
-        if (state != SUCCESS)
-            return state;
+    return state;
+}
+
+// Copies the table for one job of a script or one request to the server
+// only the array of cells is copied, the text stays shared with the table
+// cells of the snapshot write their new text into its own blocks, see setCellText()
+// plan, which does not change text of any cell, shares the cells too
+// layout commands and sort change only the view of the snapshot
+state_t snapshotTable(table_t *table, table_t *snapshot, plan_t *plan) {
+    initTable(snapshot, table->delimiter);
+
+    bool readOnly = true;
+    for (int i=0; i<plan->numSteps; i++)
+        readOnly = readOnly && (plan->steps[i].command->fnRow == NULL);
+
+    if (readOnly) {
+        *snapshot = *table;
+        snapshot->input.output = NULL;
+        snapshot->blocks = NULL;
+        snapshot->rowSelected = NULL;
+        snapshot->sharedInput = true;
+        snapshot->sharedCells = true;
+        return SUCCESS;
+    }
 
-        pos += direction;
+    // the same choice as in main()
+    bool byColumns = (plan->steps[0].command->type != LAYOUT);
+
+    size_t numCells = (size_t)countRows(table) * countColumns(table);
+    state_t state = reserveCells(snapshot, numCells > 0 ? numCells : 1);
+    if (state != SUCCESS)
+        return state;
+
+    snapshot->numRows = table->numRows;
+    snapshot->numCols = table->numCols;
+    snapshot->input = table->input;
+    snapshot->input.output = NULL;
+    snapshot->sharedInput = true;
+
+    if (byColumns) {
+        copyByColumns(table, snapshot->cells);
+        snapshot->byColumns = true;
+    } else {
+        memcpy(snapshot->cells, table->cells, numCells * sizeof(cell_t));
     }
     return SUCCESS;
 }
 
+// splits the line of a script into words separated by white space, like a shell does with arguments
+// a word can be put in double quotes, inside them a quote and a backslash are written with a backslash
+// words are ended with '\0' in place, returns their number or -1 for a quote without its end
+int splitWords(char *line, char **words) {
+    int numWords = 0;
+    char *from = line;
+
+    while (true) {
+        while (isSpace(*from))
+            from++;
+
+        // whole line can be a comment
+        if ((*from == '\0') || ((numWords == 0) && (*from == '#')))
+            return numWords;
+
+        char *to = from;
+        words[numWords++] = to;
+
+        bool quoted = false;
+        while ((*from != '\0') && (quoted || !isSpace(*from))) {
+            if (*from == '"') {
+                quoted = !quoted;
+                from++;
+                continue;
+            }
 
-state_t selectRows(table_t *table, int start, int end) {
-    int numRows = countRows(table);
-    int numCols = countColumns(table);
+            if (quoted && (*from == '\\') && ((from[1] == '"') || (from[1] == '\\')))
+                from++;
 
-    if (end == DASH_NUMBER) {
-        // command like "rows 5 -" selectslines from 5 to the end
-        if (start == DASH_NUMBER) {
-            // special case for "rows - -", which selects only the last line
-            start = numCols;
+            *to++ = *from++;
         }
-        end = numCols;
-    }
 
-    if (start > end)
-        return ERR_BAD_SYNTAX;
+        if (quoted)
+            return -1;
 
-    if ((end > numCols) || (start < 1))
-        return ERR_OUT_OF_RANGE;
+        bool end = (*from == '\0');
+        *to = '\0';
+        if (end)
+            return numWords;
+        from++;
+    }
+}
 
-    for (int row=1; row<=numRows; row++) {
-        bool selected = (row >= start) && (row <= end);
-        table->rowSelected[row] = table->rowSelected[row] && selected;
+// runs the commands from the words on a snapshot of the table
+// the plan and the snapshot have to be freed, even if it fails
+state_t runCommands(options_t *options, table_t *table, char **words, int numWords,
+        plan_t *plan, table_t *snapshot) {
+    arguments_t args = {.argc=numWords, .index=0, .argv=words};
+    initTable(snapshot, table->delimiter);
+
+    state_t state = parseCommands(&args, plan);
+    if (state == SUCCESS) {
+        plan->numThreads = options->numThreads;
+        plan->sortMemory = options->sortMemory;
+        STATS(plan->stats = options->stats;)
+        state = snapshotTable(table, snapshot, plan);
     }
 
-    return SUCCESS;
+    if (state == SUCCESS)
+        state = executePlan(plan, snapshot);
+
+    // the same as in main(), an empty table is reported even after other errors
+    if ((snapshot->cells != NULL) && isEmpty(snapshot))
+        state = ERR_TABLE_EMPTY;
+
+    return state;
 }
 
-state_t selectBeginsWith(table_t *table, int col, char *str) {
-    int numRows = countRows(table);
+// runs one job of a script on a snapshot of the table
+// the first word is the file for the output, the rest are the commands
+state_t runJob(options_t *options, table_t *table, output_t *output, char **words, int numWords) {
+    plan_t plan = {0};
+    table_t snapshot;
+    state_t state = runCommands(options, table, &words[1], numWords-1, &plan, &snapshot);
 
-    if (col < 1 || col > countColumns(table))
-        return ERR_OUT_OF_RANGE;
+    // the file is not touched, if the job fails
+    if (state == SUCCESS) {
+        output->fd = open(words[0], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (output->fd < 0)
+            state = ERR_OUTPUT_FILE;
+    }
 
-    for (int row=1; row<=numRows; row++) {
-        char content[MAX_CELL_LENGTH];
-        readCell(table, row, col, content);
-        bool selected = (strstr(content, str) == &content[0]);
-        table->rowSelected[row] = table->rowSelected[row] && selected;
+    if (state == SUCCESS) {
+        STATS(uint64_t start = startStats(&plan);)
+        state = printTable(&snapshot, output);
+        if (state == SUCCESS)
+            state = flushOutput(output);
+        STATS(stopStats(&plan, &snapshot, &plan.printStats, start, countRows(&snapshot));)
+
+        // rest of the output is thrown away after an error
+        output->numPieces = 0;
+        output->used = 0;
+        if ((close(output->fd) != 0) && (state == SUCCESS))
+            state = ERR_WRITE;
     }
-    return SUCCESS;
-}
 
-state_t selectContains(table_t *table, int col, char *str) {
-    int numRows = countRows(table);
+#ifdef SHEET_STATS
+    if (options->stats && (plan.numSteps > 0))
+        printStepStats(&plan);
+#endif
 
-    if (col < 1 || col > countColumns(table))
-        return ERR_OUT_OF_RANGE;
+    freePlan(&plan);
+    freeTable(&snapshot);
+    return state;
+}
 
-    for (int row=1; row<=numRows; row++) {
-        char content[MAX_CELL_LENGTH];
-        readCell(table, row, col, content);
-        // if str is found in the content of the cell
-        bool selected = (strstr(content, str) != NULL);
-        table->rowSelected[row] = table->rowSelected[row] && selected;
+// Runs every line of the script as a job on the table, which was read only once
+// every job gets its own snapshot of the table, so the jobs do not affect each other
+// errors are reported with the line of the job and the other jobs go on
+state_t runScript(plan_t *base, options_t *options, table_t *table, output_t *output) {
+    (void)base;
+    char *text;
+    size_t length;
+    state_t state = readFile(options->script, &text, &length, ERR_SCRIPT_FILE);
+    if (state != SUCCESS)
+        return state;
+
+    // every word takes at least two characters, except for the last one
+    char **words = malloc((length/2 + 1) * sizeof(char *));
+    if (words == NULL) {
+        free(text);
+        return ERR_NO_MEMORY;
     }
-    return SUCCESS;
+
+#ifdef SHEET_STATS
+    if (base->stats)
+        printReadStats(base);
+#endif
+
+    bool failed = false;
+    int numJobs = 0;
+    int lineNumber = 0;
+    char *line = text;
+    while (line < &text[length]) {
+        char *end = memchr(line, '\n', &text[length] - line);
+        if (end == NULL)
+            end = &text[length];
+        *end = '\0';
+        lineNumber++;
+
+        int numWords = splitWords(line, words);
+        if (numWords != 0) {
+            numJobs++;
+            state = (numWords < 0) ? ERR_BAD_SYNTAX : runJob(options, table, output, words, numWords);
+            if (state != SUCCESS) {
+                fprintf(stderr, "%s:%d: ", options->script, lineNumber);
+                printErrorMessage(state);
+                failed = true;
+            }
+        }
+        line = end + 1;
+    }
+
+    free(words);
+    free(text);
+
+    if (numJobs == 0)
+        return NOT_FOUND;
+
+    return failed ? ERR_JOB_FAILED : SUCCESS;
 }
 
-// select all rows of the table
-// different form all the selection functions
-// assigns the value directly, whereas the other functions use and operator
-void selectAll(table_t *table) {
-    int numRows = countRows(table);
+// one of the tables kept by the server
+typedef struct {
+    char *name; // the file, as it was given in the arguments
+    table_t table;
+} named_table_t;
 
-    for (int row=1; row<=numRows; row++)
-        table->rowSelected[row] = true;
+// one client of the server
+typedef struct {
+    options_t *options;
+    named_table_t *tables;
+    int numTables;
+    int fd;
+} connection_t;
+
+// returns the number of bytes printTable() writes
+size_t tableLength(table_t *table) {
+    size_t length = 0;
+    for (int row=1; row<=countRows(table); row++) {
+        for (int col=1; col<=countColumns(table); col++)
+            length += getCell(table, row, col)->length + 1;
+    }
+    return length;
 }
 
-// reads command's parameters from args and executes it
-state_t executeCommand(command_t *command, arguments_t *args, table_t *table) {
-    // read all command's parameters
-    int parameters[command->numParameters];
+// answers one request: the first word is the table, the rest are the commands
+// errors are sent to the client, the returned state says, if the connection still works
+state_t answerRequest(connection_t *connection, output_t *output, char **words, int numWords) {
+    named_table_t *named = NULL;
+    for (int i=0; (i<connection->numTables) && (numWords > 0); i++) {
+        if (strcmp(connection->tables[i].name, words[0]) == 0)
+            named = &connection->tables[i];
+    }
 
-    for (int k=0; k < command->numParameters; k++) {
-        if (!readInt(args, &parameters[k])) {
-            return ERR_BAD_SYNTAX;
-        }
+    // clients cannot make the server read files
+    plan_t plan = {.serving = true};
+    table_t snapshot;
+    initTable(&snapshot, ' ');
+
+    state_t state;
+    if (numWords < 0)
+        state = ERR_BAD_SYNTAX;
+    else if (named == NULL)
+        state = ERR_NO_TABLE;
+    else
+        state = runCommands(connection->options, &named->table, &words[1], numWords-1, &plan, &snapshot);
+
+    char header[64];
+    if (state == SUCCESS) {
+        snprintf(header, sizeof(header), "OK %zu\n", tableLength(&snapshot));
+        state = writeOutput(output, header, strlen(header));
+        if (state == SUCCESS)
+            state = printTable(&snapshot, output);
+    } else {
+        state_t error = state;
+        state = writeOutput(output, "ERROR ", 6);
+        if (state == SUCCESS)
+            state = writeOutput(output, errorMessage(error), strlen(errorMessage(error)));
+        if (state == SUCCESS)
+            state = writeOutput(output, "\n", 1);
     }
 
-    if (!command->hasStringParameter) {
-        switch (command->numParameters) {
-            case 0: return command->fnZero(table);
-            case 1: return command->fnOne(table, parameters[0]);
-            case 2: return command->fnTwo(table, parameters[0], parameters[1]);
+    // pieces of the output can point into the snapshot
+    if (state == SUCCESS)
+        state = flushOutput(output);
+
+    freePlan(&plan);
+    freeTable(&snapshot);
+    return state;
+}
+
+// reads requests of one client one line at a time and answers them, until the client closes the connection
+void *serveConnection(void *arg) {
+    connection_t *connection = arg;
+
+    output_t *output = malloc(sizeof(output_t));
+    input_t input = {.fd=connection->fd};
+    char **words = NULL;
+    size_t wordsCapacity = 0;
+
+    unsigned char classes[256];
+    buildCharClasses("", classes);
+
+    state_t state = (output == NULL) ? ERR_NO_MEMORY : SUCCESS;
+    if (output != NULL)
+        *output = (output_t){.fd=connection->fd, .numPieces=0, .used=0, .copyAll=false};
+
+    size_t length;
+    while ((state == SUCCESS) && ((state = nextRow(&input, classes, &length)) == SUCCESS) && (length > 0)) {
+        // the line is copied, the input buffer can move while the answer is written
+        char *line = strndup(&input.buffer[input.position], length);
+        input.position += length;
+
+        // every word takes at least two characters, except for the last one
+        if ((line != NULL) && (length/2 + 1 > wordsCapacity)) {
+            char **bigger = realloc(words, (length/2 + 1) * sizeof(char *));
+            if (bigger != NULL) {
+                words = bigger;
+                wordsCapacity = length/2 + 1;
+            }
+        }
+
+        if ((line == NULL) || (length/2 + 1 > wordsCapacity)) {
+            free(line);
+            break;
         }
+
+        int numWords = splitWords(line, words);
+        // empty lines are not requests
+        if (numWords != 0)
+            state = answerRequest(connection, output, words, numWords);
+        free(line);
     }
 
-    // if command does have string parameter
-    // there is only one type of command with string
-    char strParameter[MAX_CELL_LENGTH];
-    strcpy(strParameter, args->argv[args->index]);
-    args->index++;
-    return command->fnOneStr(table, parameters[0], strParameter);
+    free(words);
+    free(output);
+    free(input.buffer);
+    close(connection->fd);
+    free(connection);
+    return NULL;
 }
 
-// Can these two commands be after each other
-bool isValidOrder (type_of_command_t currentCommand, type_of_command_t lastCommand) {
-    switch (lastCommand) {
-        case NOT_SET:
-            return true;
-        case LAYOUT:
-            // there can be only layout command
-            if (currentCommand == LAYOUT)
-                return true;
-            break;
+// Reads the tables given as arguments and answers requests on the unix socket
+// every client gets its own thread, the tables are shared by all of them and never change,
+// every request works with its own snapshot, see snapshotTable()
+// it runs until it is killed, so it returns only errors
+state_t serveTables(options_t *options, arguments_t *args) {
+    int numTables = args->argc - args->index;
+    if (numTables < 1)
+        return ERR_BAD_SYNTAX;
 
-        case DATA:
-            // there can be only data command
-            return false;
-            break;
+    named_table_t *tables = malloc(numTables * sizeof(named_table_t));
+    if (tables == NULL)
+        return ERR_NO_MEMORY;
 
-        case SELECTION:
-            // there can be another selection or data command
-            if ((currentCommand == DATA) || (currentCommand == SELECTION))
-                return true;
-            break;
+    state_t state = SUCCESS;
+    int numRead = 0;
+    for (; (numRead < numTables) && (state == SUCCESS); numRead++) {
+        named_table_t *named = &tables[numRead];
+        named->name = args->argv[args->index + numRead];
 
-        default: // should never happen
-            break;
+        int fd = open(named->name, O_RDONLY);
+        if (fd < 0) {
+            initTable(&named->table, options->delimiters[0]);
+            state = ERR_READ;
+            continue;
+        }
+
+        state = readTable(options, &named->table, fd);
+        close(fd);
     }
-    return false;
-}
 
-// takes in arguments and recognizes commands
-// commands are executed right after they are found
-state_t parseCommands(arguments_t *args, table_t *table) {
-    command_t commands[NUM_COMMANDS] = {
-        {.type=LAYOUT, .name="irow", .numParameters=1, .fnOne=irow},
-        {.type=LAYOUT, .name="arow", .numParameters=0, .fnZero=arow},
-        {.type=LAYOUT, .name="drow", .numParameters=1, .fnOne=drow},
-        {.type=LAYOUT, .name="drows", .numParameters=2, .fnTwo=drows},
-        {.type=LAYOUT, .name="icol", .numParameters=1, .fnOne=icol},
-        {.type=LAYOUT, .name="acol", .numParameters=0, .fnZero=acol},
-        {.type=LAYOUT, .name="dcol", .numParameters=1, .fnOne=dcol},
-        {.type=LAYOUT, .name="dcols", .numParameters=2, .fnTwo=dcols},
-
-        {.type=DATA, .name="cset", .numParameters=1, .hasStringParameter=true, .fnOneStr=setColumn},
-        {.type=DATA, .name="tolower", .numParameters=1, .fnOne=lowerColumn},
-        {.type=DATA, .name="toupper", .numParameters=1, .fnOne=upperColumn},
-        {.type=DATA, .name="round", .numParameters=1, .fnOne=roundColumn},
-        {.type=DATA, .name="int", .numParameters=1, .fnOne=intColumn},
-        {.type=DATA, .name="copy", .numParameters=2, .fnTwo=copyColumn},
-        {.type=DATA, .name="swap", .numParameters=2, .fnTwo=swapColumn},
-        {.type=DATA, .name="move", .numParameters=2, .fnTwo=moveColumn},
-
-        {.type=SELECTION, .name="rows", .numParameters=2, .fnTwo=selectRows},
-        {.type=SELECTION, .name="beginswith", .numParameters=1, .hasStringParameter=true, .fnOneStr=selectBeginsWith},
-        {.type=SELECTION, .name="contains", .numParameters=1, .hasStringParameter=true, .fnOneStr=selectContains}
-    };
+    struct sockaddr_un address = {.sun_family=AF_UNIX};
+    int listener = -1;
+    if ((state == SUCCESS) && (strlen(options->socket) >= sizeof(address.sun_path)))
+        state = ERR_SOCKET;
 
-    if (args->index >= args->argc)
-        return NOT_FOUND;
+    if (state == SUCCESS) {
+        strcpy(address.sun_path, options->socket);
 
-    type_of_command_t lastCommandType = NOT_SET;
-    while (args->index < args->argc) {
-        // if no command is found, it is bad syntax
-        state_t state = ERR_BAD_SYNTAX;
-
-        // go through all the commands and check if any name matches
-        for (int i=0; i<NUM_COMMANDS; i++) {
-            if (strcmp(commands[i].name, args->argv[args->index]) == 0) {
-                args->index++; //successfully found a valid command
-                if (!isValidOrder(commands[i].type, lastCommandType))
-                    return ERR_BAD_ORDER;
-
-                state = executeCommand(&commands[i], args, table);
-                lastCommandType = commands[i].type;
-                // we don't have to check this argument anymore
-                break;
-            }
+        // socket left behind by a previous server is replaced, other files are not
+        struct stat st;
+        if ((stat(options->socket, &st) == 0) && S_ISSOCK(st.st_mode))
+            unlink(options->socket);
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((listener < 0) || (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+                || (listen(listener, SERVER_BACKLOG) != 0))
+            state = ERR_SOCKET;
+    }
+
+    // client, which closes the connection early, must not kill the server
+    if (state == SUCCESS)
+        signal(SIGPIPE, SIG_IGN);
+
+    while (state == SUCCESS) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if ((errno != EINTR) && (errno != ECONNABORTED))
+                state = ERR_SOCKET;
+            continue;
         }
-        if (state != SUCCESS)
-            return state;
+
+        connection_t *connection = malloc(sizeof(connection_t));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        *connection = (connection_t){.options=options, .tables=tables, .numTables=numTables, .fd=fd};
+
+        // the client is served here, if there is no thread for it
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &serveConnection, connection) == 0)
+            pthread_detach(thread);
+        else
+            serveConnection(connection);
     }
-    return SUCCESS;
+
+    if (listener >= 0)
+        close(listener);
+    for (int i=0; i<numRead; i++)
+        freeTable(&tables[i].table);
+    free(tables);
+    return state;
 }
 
 int main(int argc, char **argv) {
     arguments_t args = {.argc=argc, .index=1, .argv=argv};
 
     table_t table;
+    options_t options;
+    plan_t plan = {0};
+    output_t output = {.fd=STDOUT_FILENO, .numPieces=0, .used=0, .copyAll=false};
     state_t state;
 
-    state = readTable(&args, &table);
-    // by default all rows are selected
-    selectAll(&table);
+    readOptions(&args, &options);
+    initKernels();
+    initTable(&table, options.delimiters[0]);
+
+    state = SUCCESS;
+#ifndef SHEET_STATS
+    // the counters are not there, the flag is rejected, whatever it is used with
+    if (options.stats)
+        state = ERR_NO_STATS;
+#endif
+
+    // all commands are checked before the table is read
+    // the server gets the commands from its clients, it returns only after an error
+    if ((state == SUCCESS) && (options.socket != NULL)) {
+        state = ERR_BAD_SYNTAX;
+        if ((options.script == NULL) && !options.stream && (options.cache == NULL))
+            state = serveTables(&options, &args);
+    } else if (state == SUCCESS) {
+        state = parseCommands(&args, &plan);
+
+        // commands of a script are in its file
+        if ((options.script != NULL) && (state != ERR_NO_MEMORY))
+            state = ((state == NOT_FOUND) && !options.stream) ? SUCCESS : ERR_BAD_SYNTAX;
+
+        // there is no parsed table in streaming mode
+        if ((state == SUCCESS) && options.stream && (options.cache != NULL))
+            state = ERR_BAD_SYNTAX;
+    }
 
-    if (state == SUCCESS)
-        state = parseCommands(&args, &table);
+    if (state == SUCCESS) {
+        // data and selection commands work with columns, layout commands with rows
+        // they cannot be combined, so the first command decides how the table is stored
+        // jobs of a script choose it for their snapshots
+        options.byColumns = (options.script == NULL) && (plan.steps[0].command->type != LAYOUT);
+        plan.numThreads = options.numThreads;
+        plan.sortMemory = options.sortMemory;
+        STATS(plan.stats = options.stats;)
+
+        if (options.stream) {
+            state = streamTable(&plan, &options, &table, &output);
+
+            // rows printed before an error are written too
+            state_t flushed = flushOutput(&output);
+            if (state == SUCCESS)
+                state = flushed;
+        } else {
+            STATS(uint64_t start = startStats(&plan);)
+            state = readTable(&options, &table, STDIN_FILENO);
+            STATS(table.stats.bytes += table.input.length;)
+            STATS(stopStats(&plan, &table, &plan.readStats, start, countRows(&table));)
+
+            if ((state == SUCCESS) && (options.script == NULL))
+                state = executePlan(&plan, &table);
+
+            // table was not read at all, jobs of a script check their own snapshots
+            // a bad table is only partly read, it keeps its own error
+            if ((state != ERR_BAD_TABLE) && (table.input.buffer != NULL) && (options.script == NULL) && isEmpty(&table))
+                state = ERR_TABLE_EMPTY;
+
+            if ((state == SUCCESS) && (options.script != NULL)) {
+                state = runScript(&plan, &options, &table, &output);
+            } else if (state == SUCCESS) {
+                STATS(start = startStats(&plan);)
+                state = printTable(&table, &output);
+                if (state == SUCCESS)
+                    state = flushOutput(&output);
+                STATS(stopStats(&plan, &table, &plan.printStats, start, countRows(&table));)
+            }
+        }
 
-    if (isEmpty(&table))
-        state = ERR_TABLE_EMPTY;
+#ifdef SHEET_STATS
+        // jobs of a script print their own stats
+        if (options.stats && (options.script == NULL))
+            printPlanStats(&plan);
+#endif
+    }
 
-    if (state == SUCCESS) {
-        printTable(&table);
+    int badRow = table.badRow;
+    freePlan(&plan);
+    freeTable(&table);
+
+    if (state == SUCCESS)
         return EXIT_SUCCESS;
-    }
 
     printErrorMessage(state);
+    if ((state == ERR_BAD_TABLE) && (badRow > 0))
+        fprintf(stderr, "Row %d has different number of columns than the first row\n", badRow);
     return EXIT_FAILURE;
 }